@@ -13,6 +13,7 @@
 
 /* Applications */
 #include "MifareClassic.h"
+#include "Type2Tag.h"
 #include "MifareUltralight.h"
 #include "NTAG21x.h"
 /* Function wrappers */
@@ -32,6 +33,12 @@ INLINE void ApplicationButton(void) {
     ActiveConfiguration.ApplicationButtonFunc();
 }
 
+INLINE void ApplicationFlush(void) {
+    if (ActiveConfiguration.ApplicationFlushFunc != NULL) {
+        ActiveConfiguration.ApplicationFlushFunc();
+    }
+}
+
 INLINE uint16_t ApplicationProcess(uint8_t* ByteBuffer, uint16_t ByteCount) {
     return ActiveConfiguration.ApplicationProcessFunc(ByteBuffer, ByteCount);
 }
@@ -1,5 +1,6 @@
 #include "Crypto1.h"
 #include "../Common.h"
+#include "../Perf.h"
 
 /* avoid compiler complaining at the shift macros */
 #pragma GCC diagnostic ignored "-Wuninitialized"
@@ -103,6 +104,8 @@ uint8_t Crypto1FilterOutput(void) {
 static void Crypto1LFSR(uint8_t In) {
     uint8_t Feedback = 0;
 
+    PERF_COUNT(Crypto1Clocks);
+
     /* Calculate feedback according to LFSR taps. XOR all 6 state bytes
     * into a single bit. */
     Feedback ^= StateEven[0] & (uint8_t) (LFSR_MASK_EVEN >> 0);
@@ -147,7 +150,7 @@ static void Crypto1LFSR(uint8_t In) {
     StateOdd[2] = (uint8_t) (Temp >> 16);
 }
 
-void Crypto1Setup(uint8_t Key[6], uint8_t Uid[4], uint8_t CardNonce[4], uint8_t CardNonceParity[4])
+void Crypto1Setup(uint8_t Key[6], uint8_t Uid[4], uint8_t CardNonce[4], uint8_t* CardNonceParity)
 {
     uint8_t i;
 
@@ -182,6 +185,8 @@ void Crypto1Setup(uint8_t Key[6], uint8_t Uid[4], uint8_t CardNonce[4], uint8_t
 
     /* Use Uid XOR CardNonce as feed-in and do 32 clocks on the
     * Crypto1 LFSR.*/
+    if (CardNonceParity)
+        *CardNonceParity = 0;
     for (i=0; i<4; i++) {
         uint8_t Mask = 1;
         uint8_t Keystream = 0;
@@ -195,8 +200,8 @@ void Crypto1Setup(uint8_t Key[6], uint8_t Uid[4], uint8_t CardNonce[4], uint8_t
             Crypto1LFSR(Temp & 0x01);
         }
         CardNonce[i] = Nonce ^ Keystream;
-        if (CardNonceParity)
-            CardNonceParity[i] = ODD_PARITY(Nonce) ^ Crypto1FilterOutput();
+        if (CardNonceParity && (ODD_PARITY(Nonce) ^ Crypto1FilterOutput()))
+            *CardNonceParity |= 1 << i;
     }
 }
 
@@ -6,8 +6,9 @@
 
 /* Set up Crypto1 cipher using the given Key, Uid and CardNonce. Also encrypts
  * the CardNonce in-place while in non-linear mode.
- * If CardNonceParity is not null, saves parity for nested authentication */
-void Crypto1Setup(uint8_t Key[6], uint8_t Uid[4], uint8_t CardNonce[4], uint8_t CardNonceParity[4]);
+ * If CardNonceParity is not null, saves parity for nested authentication,
+ * the one of byte n in bit n */
+void Crypto1Setup(uint8_t Key[6], uint8_t Uid[4], uint8_t CardNonce[4], uint8_t* CardNonceParity);
 
 
 /* Load the decrypted ReaderNonce into the Crypto1 state LFSR */
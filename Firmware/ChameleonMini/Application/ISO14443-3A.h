@@ -41,15 +41,27 @@
 #define ISO14443A_UID0_CT           0x88
 
 #define ISO14443A_CRCA_SIZE         2
+#define ISO14443A_CRCA_INIT         0x6363
 
 #define ISO14443A_CALC_BCC(ByteBuffer) \
     ( ByteBuffer[0] ^ ByteBuffer[1] ^ ByteBuffer[2] ^ ByteBuffer[3] )
 
 void ISO14443AAppendCRCA(void* Buffer, uint16_t ByteCount);
 bool ISO14443ACheckCRCA(const void* Buffer, uint16_t ByteCount);
+bool ISO14443ACheckFrameCRCA(const void* Buffer, uint16_t ByteCount);
 bool ISO14443AIsWakeUp(uint8_t* Buffer, bool FromHalt);
 void ISO14443ASetWakeUpResponse(uint8_t* Buffer, uint16_t ATQAValue);
 bool ISO14443AWakeUp(void* Buffer, uint16_t* BitCount, uint16_t ATQAValue, bool FromHalt);
 bool ISO14443ASelect(void* Buffer, uint16_t* BitCount, uint8_t* UidCL, uint8_t SAKValue);
 
+#ifdef SUPPORT_STREAMING_CRC
+/* Reflected CRC_A, one byte at a time. Running it over the data and its CRC gives 0. */
+INLINE uint16_t ISO14443AUpdateCRCA(uint16_t Checksum, uint8_t Byte)
+{
+    extern const uint16_t PROGMEM ISO14443ACRCATable[];
+
+    return (Checksum >> 8) ^ pgm_read_word(&ISO14443ACRCATable[(Checksum ^ Byte) & 0xFF]);
+}
+#endif
+
 #endif
@@ -17,8 +17,10 @@
 #include "../Random.h"
 #include "../Codec/ISO14443-2A.h"
 #include "../Memory/Memory.h"
+#include "../Memory/SPIFlash.h"
+#include "../Terminal/XModem.h"
 #ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
-#include "System.h"
+#include "../System.h"
 #endif
 
 // UNUSED
@@ -143,6 +145,7 @@ static const uint8_t abTrailorAccessConditions[8][2] = {
     },
 };
 
+/* Logged as state id, keep in sync with LogStateNames and Software/Tools/mfc_log_decode.py */
 enum estate {
     STATE_HALT,
     STATE_IDLE,
@@ -161,23 +164,6 @@ enum estate {
 /* Init to get sure we have a controlled value wherever we start */
 static enum estate State = STATE_IDLE;
 
-#ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
-char *estate_str[] = {
-    "HALT",
-    "IDLE",
-    "CHINESE_IDLE",
-    "CHINESE_WRITE",
-    "READY",
-    "ACTIVE",
-    "AUTHING",
-    "AUTHED_IDLE",
-    "WRITE",
-    "INCREMENT",
-    "DECREMENT",
-    "RESTORE"
-};
-#endif
-
 static uint8_t CardResponse[MFCLASSIC_MEM_NONCE_SIZE];
 static uint8_t ReaderResponse[MFCLASSIC_MEM_NONCE_SIZE];
 static uint8_t CurrentAddress;
@@ -208,13 +194,82 @@ static uint32_t BruteCurrentUid = 0;
 #endif
 #ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
 static bool isLogEnabled = false;
+/* Log bytes up to the last complete record committed to flash, as stored in the header */
 static uint32_t LogBytesWrote = 0;
-static uint16_t LogBytesBuffered = 0;
+/* Records are numbered consecutively. The numbers are not stored but counted
+ * from the one of the record at the start of the log. */
+static uint32_t LogFirstSequence = 0;
+static uint32_t LogCommittedSequence = 0;
+static uint32_t LogNextSequence = 0;
+/* Where the last LOGSYNC ended, saves walking the log on the next one */
+static uint32_t LogCursorSequence = 0;
+static uint32_t LogCursorAddress = 0;
+/* Records streamed by a LOGSYNC */
+static uint8_t LogSyncHeader[MFCLASSIC_LOG_SYNC_HEADER_LEN];
+static uint32_t LogSyncAddress = 0;
+static uint32_t LogSyncLength = 0;
 static uint32_t LogMaxBytes = 0;
-static uint8_t LogLineBufferA[MFCLASSIC_LOG_MEM_LINE_BUFFER_LEN] = { 0 };
-static uint8_t LogLineBufferB[MFCLASSIC_LOG_MEM_LINE_BUFFER_LEN] = { 0 };
+static uint8_t LogFlushesSinceHeader = 0;
+static bool LogFrameSeen = false;
+/* Buffer being filled by the RF path, and where it will land in the log */
+static uint8_t LogLineBufferA[MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN] = { 0 };
+static uint8_t LogLineBufferB[MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN] = { 0 };
 static uint8_t * LogLineBuffer = LogLineBufferA;
 static bool LogLineBufferFirst = true;
+static uint16_t LogBytesBuffered = 0;
+static uint16_t LogBufferLimit = 0;
+static uint32_t LogBufferAddress = 0;
+static uint32_t LogBufferStartSequence = 0; // Of the first record, if the buffer starts the log
+static uint16_t LogBufferComplete = 0; // Bytes up to the end of the last complete record
+static uint32_t LogBufferCompleteSequence = 0;
+static bool LogBufferOverflow = false;
+/* Collapsing of repeated exchanges */
+typedef struct {
+    uint32_t Timestamp;
+    uint8_t Info;
+    uint16_t BitCount;
+    uint8_t Data[MFCLASSIC_LOG_EXCHANGE_FRAME_LEN];
+} LogFrameType;
+static LogFrameType LogReaderFrame;
+static bool LogReaderHeld = false;
+static LogFrameType LogLastReaderFrame;
+static LogFrameType LogLastTagFrame;
+static bool LogLastExchangeValid = false;
+static uint16_t LogRepeatCount = 0;
+static uint32_t LogRepeatTimestamp = 0;
+/* Capture filter, compiled by MifareClassicAppLogSetFilter() */
+typedef struct {
+    uint8_t Commands[MFCLASSIC_LOG_FILTER_COMMANDS_LEN]; // One bit per reader command byte
+    uint16_t States; // One bit per enum estate
+    uint8_t Directions;
+    uint8_t MaxPayload;
+} LogFilterType;
+static LogFilterType LogFilter;
+static bool LogFilterActive = false;
+static bool LogExchangeSkipped = false;
+/* Same order as enum estate */
+static const char LogStateNames[][14] PROGMEM = {
+    "HALT",
+    "IDLE",
+    "CHINESE_IDLE",
+    "CHINESE_WRITE",
+    "READY",
+    "ACTIVE",
+    "AUTHING",
+    "AUTHED_IDLE",
+    "WRITE",
+    "INCREMENT",
+    "DECREMENT",
+    "RESTORE"
+};
+/* Buffer handed over to the main loop for writing, if any. The other LogPending
+ * fields belong to the main loop as long as it is set. */
+static uint8_t * volatile LogPendingBuffer = NULL;
+static uint16_t LogPendingBytes = 0;
+static uint32_t LogPendingAddress = 0;
+static uint32_t LogPendingStartSequence = 0;
+static uint16_t LogPendingComplete = 0;
+static uint32_t LogPendingCompleteSequence = 0;
 #endif
 
 /* decode Access conditions for a block */
@@ -413,7 +468,10 @@ void MifareClassicAppBruteTick(void) {
     // If we were using same UID for too long, change it
     if( isBruteEnabled ) {
         if( BruteIdleRounds >= BRUTE_IDLE_MAX_ROUNDS ) {
+            /* Changes the UID and the state under the codec interrupt */
+            CodecProcessLock();
             MifareClassicAppBruteMove();
+            CodecProcessUnlock();
         } else {
             BruteIdleRounds++;
         }
@@ -429,65 +487,480 @@ void MifareClassicAppLogCheck(void) {
         || (headerLine[MFCLASSIC_LOG_MEM_STATUS_CANARY_ADDR] == MFCLASSIC_LOG_MEM_STATUS_RESET) ) {
         isLogEnabled = (headerLine[MFCLASSIC_LOG_MEM_STATUS_CANARY_ADDR] == MFCLASSIC_LOG_MEM_STATUS_CANARY);
         LogBytesWrote = BytesToUint32(&headerLine[MFCLASSIC_LOG_MEM_WROTEBYTES_ADDR]);
+        LogFirstSequence = BytesToUint32(&headerLine[MFCLASSIC_LOG_MEM_FIRSTSEQ_ADDR]);
+        LogCommittedSequence = BytesToUint32(&headerLine[MFCLASSIC_LOG_MEM_COMMITSEQ_ADDR]);
+        LogCursorSequence = BytesToUint32(&headerLine[MFCLASSIC_LOG_MEM_CURSORSEQ_ADDR]);
+        LogCursorAddress = BytesToUint32(&headerLine[MFCLASSIC_LOG_MEM_CURSORADDR_ADDR]);
+        /* Do not append records to a log written in a former format */
+        if (headerLine[MFCLASSIC_LOG_MEM_FORMAT_ADDR] != MFCLASSIC_LOG_MEM_FORMAT_BINARY) {
+            LogBytesWrote = 0;
+            LogFirstSequence = LogCommittedSequence = LogCursorSequence = LogCursorAddress = 0;
+        }
     } else {
         isLogEnabled = true;
         LogBytesWrote = 0;
+        LogFirstSequence = LogCommittedSequence = LogCursorSequence = LogCursorAddress = 0;
     }
 }
 
 void MifareClassicAppLogWriteHeader(void) {
     uint8_t headerLine[MFCLASSIC_LOG_MEM_LOG_HEADER_LEN] = { 0 };
     headerLine[MFCLASSIC_LOG_MEM_STATUS_CANARY_ADDR] = (isLogEnabled) ? (MFCLASSIC_LOG_MEM_STATUS_CANARY) : (MFCLASSIC_LOG_MEM_STATUS_RESET);
+    headerLine[MFCLASSIC_LOG_MEM_FORMAT_ADDR] = MFCLASSIC_LOG_MEM_FORMAT_BINARY;
     Uint32ToBytes(LogBytesWrote, &headerLine[MFCLASSIC_LOG_MEM_WROTEBYTES_ADDR]);
+    Uint32ToBytes(LogFirstSequence, &headerLine[MFCLASSIC_LOG_MEM_FIRSTSEQ_ADDR]);
+    Uint32ToBytes(LogCommittedSequence, &headerLine[MFCLASSIC_LOG_MEM_COMMITSEQ_ADDR]);
+    Uint32ToBytes(LogCursorSequence, &headerLine[MFCLASSIC_LOG_MEM_CURSORSEQ_ADDR]);
+    Uint32ToBytes(LogCursorAddress, &headerLine[MFCLASSIC_LOG_MEM_CURSORADDR_ADDR]);
     AppWorkingMemoryWrite(headerLine, MFCLASSIC_LOG_MEM_LOG_HEADER_ADDR, MFCLASSIC_LOG_MEM_LOG_HEADER_LEN);
+    LogFlushesSinceHeader = 0;
 }
 
-void MifareClassicAppLogBufferLine(const uint8_t * Data, uint16_t BitCount, uint8_t Source) {
-    uint16_t dataBytesToBuffer = (BitCount / BITS_PER_BYTE);
-    if(BitCount % BITS_PER_BYTE) dataBytesToBuffer++;
-
-    uint16_t logStateStrLen = strlen(estate_str[State]);
-    uint16_t idx = LogBytesBuffered+MFCLASSIC_LOG_MEM_LINE_START_ADDR;
-
-    if( (idx + dataBytesToBuffer*2 + logStateStrLen + 14) < MFCLASSIC_LOG_MEM_LINE_BUFFER_LEN) {
-        idx += sprintf((char *)&LogLineBuffer[idx],"[%05u] %c:\t%s\t| ",SystemGetSysTick(),Source,estate_str[State]);
-	BufferToHexString((char *)&LogLineBuffer[idx],dataBytesToBuffer*2+1,Data,dataBytesToBuffer);
-        idx += dataBytesToBuffer*2;
-        idx += sprintf((char *)&LogLineBuffer[idx]," ;");
-    }
-    if(MFCLASSIC_LOG_MEM_LINE_BUFFER_LEN - idx > 2){
-        idx += sprintf((char *)&LogLineBuffer[idx],"\r\n");
+/* Limit the active buffer to the rest of its slot, a buffer sized and aligned
+ * part of a flash page, so that writing it out never programs more than one page */
+void MifareClassicAppLogBufferPlace(void) {
+    uint16_t SlotLeft = MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN - ((MFCLASSIC_LOG_MEM_LOG_HEADER_LEN + LogBufferAddress) % MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN);
+    if( (LogBufferAddress + SlotLeft) > LogMaxBytes ) {
+        /* circular log */
+        LogBufferAddress = 0;
+        SlotLeft = MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN - (MFCLASSIC_LOG_MEM_LOG_HEADER_LEN % MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN);
     }
-	LogBytesBuffered = idx;
+    LogBufferLimit = MIN(SlotLeft, LogMaxBytes);
+    LogBufferStartSequence = LogNextSequence;
 }
 
-void MifareClassicAppLogWriteLines(void) {
-    uint16_t LogBytesToWrite = LogBytesBuffered;
-    uint8_t * LogLineBufferToWrite = LogLineBuffer;
-    /* swap buffers */
+/* Whether the buffer following the active one, once full, starts over at the beginning of the log */
+INLINE bool MifareClassicAppLogNextWraps(void) {
+    return ( (LogBufferAddress + LogBufferLimit + MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN) > LogMaxBytes );
+}
+
+/* Hand the active buffer over to the main loop. Only swaps pointers. */
+bool MifareClassicAppLogSwapBuffers(void) {
+    if( (LogPendingBuffer != NULL) || (LogBytesBuffered == 0) ) {
+        return false;
+    }
+    LogPendingBuffer = LogLineBuffer;
+    LogPendingBytes = LogBytesBuffered;
+    LogPendingAddress = LogBufferAddress;
+    LogPendingStartSequence = LogBufferStartSequence;
+    LogPendingComplete = LogBufferComplete;
+    LogPendingCompleteSequence = LogBufferCompleteSequence;
     if ( LogLineBufferFirst ) {
         LogLineBuffer = LogLineBufferB;
-	LogLineBufferFirst = false;
+        LogLineBufferFirst = false;
     } else {
         LogLineBuffer = LogLineBufferA;
-	LogLineBufferFirst = true;
+        LogLineBufferFirst = true;
     }
+    LogBufferAddress += LogBytesBuffered;
     LogBytesBuffered = 0;
+    LogBufferComplete = 0;
+    LogBufferOverflow = false;
+    MifareClassicAppLogBufferPlace();
+    return true;
+}
+
+/* Bytes that can be buffered before the RF path has to wait for the main loop */
+INLINE uint16_t MifareClassicAppLogSpace(void) {
+    uint16_t Space = LogBufferLimit - LogBytesBuffered;
+    if( (LogPendingBuffer == NULL) && !MifareClassicAppLogNextWraps() ) {
+        Space += MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN;
+    }
+    return Space;
+}
+
+/* Append to the active buffer, swapping it out when it reached the page end.
+ * Callers make sure that MifareClassicAppLogSpace() allows for ByteCount. */
+void MifareClassicAppLogAppend(const uint8_t * Data, uint16_t ByteCount) {
+    while(ByteCount > 0) {
+        uint16_t Chunk;
+        if(LogBytesBuffered == LogBufferLimit) {
+            MifareClassicAppLogSwapBuffers();
+        }
+        Chunk = MIN(ByteCount, LogBufferLimit - LogBytesBuffered);
+        memcpy(&LogLineBuffer[LogBytesBuffered], Data, Chunk);
+        LogBytesBuffered += Chunk;
+        Data += Chunk;
+        ByteCount -= Chunk;
+    }
+}
+
+/* The record is complete, a buffer holding its end can now commit it */
+INLINE void MifareClassicAppLogRecordDone(void) {
+    LogBufferComplete = LogBytesBuffered;
+    LogBufferCompleteSequence = LogNextSequence;
+    if(LogBytesBuffered == LogBufferLimit) {
+        MifareClassicAppLogSwapBuffers();
+    }
+}
+
+INLINE uint16_t MifareClassicAppLogRecordLength(const uint8_t * Record) {
+    uint8_t RecordState = Record[MFCLASSIC_LOG_RECORD_INFO_OFFSET] & MFCLASSIC_LOG_STATE_MASK;
+    uint16_t Value = Record[MFCLASSIC_LOG_RECORD_BITCOUNT_OFFSET] | (Record[MFCLASSIC_LOG_RECORD_BITCOUNT_OFFSET + 1] << 8);
+    if( (RecordState == MFCLASSIC_LOG_REPEAT) || (RecordState == MFCLASSIC_LOG_BUFFER_OVERFLOW) ) {
+        return MFCLASSIC_LOG_RECORD_HEADER_LEN;
+    }
+    return MFCLASSIC_LOG_RECORD_HEADER_LEN + (Value + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+}
+
+INLINE void MifareClassicAppLogRecordHeader(uint8_t * Record, uint32_t Timestamp, uint8_t Info, uint16_t Value) {
+    Record[MFCLASSIC_LOG_RECORD_TIMESTAMP_OFFSET] = (uint8_t) Timestamp;
+    Record[MFCLASSIC_LOG_RECORD_TIMESTAMP_OFFSET + 1] = (uint8_t) (Timestamp >> 8);
+    Record[MFCLASSIC_LOG_RECORD_TIMESTAMP_OFFSET + 2] = (uint8_t) (Timestamp >> 16);
+    Record[MFCLASSIC_LOG_RECORD_TIMESTAMP_OFFSET + 3] = (uint8_t) (Timestamp >> 24);
+    Record[MFCLASSIC_LOG_RECORD_INFO_OFFSET] = Info;
+    Record[MFCLASSIC_LOG_RECORD_BITCOUNT_OFFSET] = (uint8_t) Value;
+    Record[MFCLASSIC_LOG_RECORD_BITCOUNT_OFFSET + 1] = (uint8_t) (Value >> 8);
+}
+
+/* Value is the bit count of the frame in Data, or the repeat count of a repeat record */
+void MifareClassicAppLogBufferRecord(uint32_t Timestamp, uint8_t Info, uint16_t Value, const uint8_t * Data, uint16_t ByteCount) {
+    uint8_t recordHeader[MFCLASSIC_LOG_RECORD_HEADER_LEN];
+    uint16_t recordLen = MFCLASSIC_LOG_RECORD_HEADER_LEN + ByteCount;
+
+    /* Never split a record where the log wraps around, the decoder could not find its start */
+    if( (recordLen > (LogBufferLimit - LogBytesBuffered)) && MifareClassicAppLogNextWraps() ) {
+        MifareClassicAppLogSwapBuffers();
+        if( (LogBytesBuffered == 0) && (recordLen > LogBufferLimit) ) {
+            /* Leave the tail of the log unused and start over */
+            LogBufferAddress = LogMaxBytes;
+            MifareClassicAppLogBufferPlace();
+        }
+    }
+    if( recordLen <= MifareClassicAppLogSpace() ) {
+        MifareClassicAppLogRecordHeader(recordHeader, Timestamp, Info, Value);
+        LogNextSequence++;
+        MifareClassicAppLogAppend(recordHeader, MFCLASSIC_LOG_RECORD_HEADER_LEN);
+        MifareClassicAppLogAppend(Data, ByteCount);
+        MifareClassicAppLogRecordDone();
+    } else if( !LogBufferOverflow && (MFCLASSIC_LOG_RECORD_HEADER_LEN <= MifareClassicAppLogSpace()) ) {
+        /* Leave a marker so the decoder can tell frames were dropped */
+        MifareClassicAppLogRecordHeader(recordHeader, Timestamp, (Info & MFCLASSIC_LOG_TAG) | MFCLASSIC_LOG_BUFFER_OVERFLOW, 0);
+        LogNextSequence++;
+        MifareClassicAppLogAppend(recordHeader, MFCLASSIC_LOG_RECORD_HEADER_LEN);
+        MifareClassicAppLogRecordDone();
+        LogBufferOverflow = true;
+    }
+}
+
+INLINE bool MifareClassicAppLogFrameEquals(const LogFrameType * Frame, uint8_t Info, uint16_t BitCount, const uint8_t * Data) {
+    return ( (Frame->Info == Info) && (Frame->BitCount == BitCount)
+             && (memcmp(Frame->Data, Data, (BitCount + BITS_PER_BYTE - 1) / BITS_PER_BYTE) == 0) );
+}
+
+/* Store how often the last exchange was seen again since it was logged */
+void MifareClassicAppLogRepeats(void) {
+    if(LogRepeatCount > 0) {
+        MifareClassicAppLogBufferRecord(LogRepeatTimestamp, MFCLASSIC_LOG_REPEAT, LogRepeatCount, NULL, 0);
+        LogRepeatCount = 0;
+    }
+}
+
+/* Apply the direction and payload length criteria of the capture filter */
+void MifareClassicAppLogFrameRecord(uint32_t Timestamp, uint8_t Info, const uint8_t * Data, uint16_t BitCount) {
+    uint16_t ByteCount = (BitCount + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
 
-    if( isLogEnabled && (LogBytesToWrite > 0) ) {
-	/* circular log */
-        if( (LogBytesWrote + LogBytesToWrite) >= LogMaxBytes) {
+    if(LogFilterActive) {
+        if( !(LogFilter.Directions & ((Info & MFCLASSIC_LOG_TAG) ? MFCLASSIC_LOG_FILTER_DIR_TAG : MFCLASSIC_LOG_FILTER_DIR_READER)) ) {
+            return;
+        }
+        if(ByteCount > LogFilter.MaxPayload) {
+            ByteCount = LogFilter.MaxPayload;
+            BitCount = ByteCount * BITS_PER_BYTE;
+            Info |= MFCLASSIC_LOG_TRUNCATED;
+        }
+    }
+    MifareClassicAppLogBufferRecord(Timestamp, Info, BitCount, Data, ByteCount);
+}
+
+/* The reader frame is held back until the tag response tells whether the exchange repeats */
+void MifareClassicAppLogReaderFrame(const uint8_t * Data, uint16_t BitCount) {
+    uint16_t ByteCount = (BitCount + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+
+    LogFrameSeen = true;
+    /* Exchanges not matching the capture filter are not logged at all */
+    LogExchangeSkipped = LogFilterActive && ( !(LogFilter.States & (1 << State))
+                         || !(LogFilter.Commands[Data[0] >> 3] & (1 << (Data[0] & 0x07))) );
+    if(LogExchangeSkipped) {
+        LogReaderHeld = false;
+        return;
+    }
+    LogReaderFrame.Timestamp = ISO14443AFrameTimes.ReaderStart;
+    LogReaderFrame.Info = MFCLASSIC_LOG_READER | State;
+    LogReaderFrame.BitCount = BitCount;
+    if(ByteCount <= MFCLASSIC_LOG_EXCHANGE_FRAME_LEN) {
+        memcpy(LogReaderFrame.Data, Data, ByteCount);
+        LogReaderHeld = true;
+    } else {
+        /* Too long to be polling traffic, log it right away */
+        MifareClassicAppLogRepeats();
+        MifareClassicAppLogFrameRecord(LogReaderFrame.Timestamp, LogReaderFrame.Info, Data, BitCount);
+        LogReaderHeld = false;
+        LogLastExchangeValid = false;
+    }
+}
+
+void MifareClassicAppLogTagFrame(const uint8_t * Data, uint16_t BitCount) {
+    uint16_t ByteCount = (BitCount + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+    uint8_t Info = MFCLASSIC_LOG_TAG | State;
+
+    if(LogExchangeSkipped) {
+        return;
+    }
+    if(LogReaderHeld) {
+        LogReaderHeld = false;
+        if( LogLastExchangeValid && (LogRepeatCount < UINT16_MAX)
+            && MifareClassicAppLogFrameEquals(&LogLastReaderFrame, LogReaderFrame.Info, LogReaderFrame.BitCount, LogReaderFrame.Data)
+            && MifareClassicAppLogFrameEquals(&LogLastTagFrame, Info, BitCount, Data) ) {
+            /* Same exchange as before, typically a polling reader */
+            LogRepeatCount++;
+            LogRepeatTimestamp = LogReaderFrame.Timestamp;
+            return;
+        }
+        MifareClassicAppLogRepeats();
+        MifareClassicAppLogFrameRecord(LogReaderFrame.Timestamp, LogReaderFrame.Info, LogReaderFrame.Data, LogReaderFrame.BitCount);
+        LogLastExchangeValid = (ByteCount <= MFCLASSIC_LOG_EXCHANGE_FRAME_LEN);
+        if(LogLastExchangeValid) {
+            LogLastReaderFrame = LogReaderFrame;
+            LogLastTagFrame.Info = Info;
+            LogLastTagFrame.BitCount = BitCount;
+            memcpy(LogLastTagFrame.Data, Data, ByteCount);
+        }
+    } else {
+        MifareClassicAppLogRepeats();
+    }
+    /* The answer goes out once the frame delay time is over */
+    MifareClassicAppLogFrameRecord(SystemGetTimestamp(), Info, Data, BitCount);
+}
+
+INLINE bool MifareClassicAppLogParseHexByte(const char * Text, uint8_t * Byte) {
+    if( !VALID_HEXCHAR(Text[0]) || !VALID_HEXCHAR(Text[1]) ) {
+        return false;
+    }
+    *Byte = (HEXCHAR_TO_NIBBLE(Text[0]) << 4) | HEXCHAR_TO_NIBBLE(Text[1]);
+    return true;
+}
+
+/* Each of the following parses one criterion value of a LOGFILTER= parameter and
+ * returns where parsing stopped, or NULL on syntax errors */
+
+/* CMD:<value>[/<mask>][+...], a command byte matches if (Byte & mask) == (value & mask) */
+const char * MifareClassicAppLogParseCommands(const char * Text, uint8_t * Bitmap) {
+    memset(Bitmap, 0, MFCLASSIC_LOG_FILTER_COMMANDS_LEN);
+    while(true) {
+        uint8_t Value;
+        uint8_t Mask = 0xFF;
+        if(!MifareClassicAppLogParseHexByte(Text, &Value)) {
+            return NULL;
+        }
+        Text += 2;
+        if(*Text == MFCLASSIC_LOG_FILTER_MASK_SEPARATOR) {
+            if(!MifareClassicAppLogParseHexByte(Text + 1, &Mask)) {
+                return NULL;
+            }
+            Text += 3;
+        }
+        for(uint16_t Byte = 0; Byte < 256; Byte++) {
+            if( (Byte & Mask) == (Value & Mask) ) {
+                Bitmap[Byte >> 3] |= (1 << (Byte & 0x07));
+            }
+        }
+        if(*Text != MFCLASSIC_LOG_FILTER_LIST_SEPARATOR) {
+            return Text;
+        }
+        Text++;
+    }
+}
+
+/* STATE:<name>[+...], with the names of enum estate */
+const char * MifareClassicAppLogParseStates(const char * Text, uint16_t * States) {
+    *States = 0;
+    while(true) {
+        uint8_t Length = strcspn(Text, MFCLASSIC_LOG_FILTER_NAME_END);
+        uint8_t i;
+        for(i = 0; i < ARRAY_COUNT(LogStateNames); i++) {
+            if( (strlen_P(LogStateNames[i]) == Length) && (strncmp_P(Text, LogStateNames[i], Length) == 0) ) {
+                *States |= (1 << i);
+                break;
+            }
+        }
+        if(i == ARRAY_COUNT(LogStateNames)) {
+            return NULL;
+        }
+        Text += Length;
+        if(*Text != MFCLASSIC_LOG_FILTER_LIST_SEPARATOR) {
+            return Text;
+        }
+        Text++;
+    }
+}
+
+/* DIR:R, DIR:T or DIR:RT */
+const char * MifareClassicAppLogParseDirections(const char * Text, uint8_t * Directions) {
+    *Directions = 0;
+    while(true) {
+        if(*Text == MFCLASSIC_LOG_FILTER_READER_CHAR) {
+            *Directions |= MFCLASSIC_LOG_FILTER_DIR_READER;
+        } else if(*Text == MFCLASSIC_LOG_FILTER_TAG_CHAR) {
+            *Directions |= MFCLASSIC_LOG_FILTER_DIR_TAG;
+        } else {
+            return (*Directions != 0) ? Text : NULL;
+        }
+        Text++;
+    }
+}
+
+/* LEN:<bytes>, frames are truncated to that many bytes */
+const char * MifareClassicAppLogParseLength(const char * Text, uint8_t * MaxPayload) {
+    uint16_t Length = 0;
+    if( (*Text < '0') || (*Text > '9') ) {
+        return NULL;
+    }
+    while( (*Text >= '0') && (*Text <= '9') ) {
+        Length = Length * 10 + (*Text++ - '0');
+        if(Length > UINT8_MAX) {
+            return NULL;
+        }
+    }
+    *MaxPayload = Length;
+    return Text;
+}
+
+/* LOGFILTER=ALL, or a comma separated list of criteria, e.g.
+ * LOGFILTER=CMD:60/FE+30,STATE:AUTHING+AUTHED_IDLE,DIR:R,LEN:8
+ * Criteria not given match everything. */
+bool MifareClassicAppLogSetFilter(const char * Filter) {
+    LogFilterType NewFilter;
+
+    if(strcmp_P(Filter, PSTR(MFCLASSIC_LOG_FILTER_ALL)) == 0) {
+        LogFilterActive = false;
+        return true;
+    }
+
+    memset(NewFilter.Commands, 0xFF, MFCLASSIC_LOG_FILTER_COMMANDS_LEN);
+    NewFilter.States = 0xFFFF;
+    NewFilter.Directions = MFCLASSIC_LOG_FILTER_DIR_READER | MFCLASSIC_LOG_FILTER_DIR_TAG;
+    NewFilter.MaxPayload = UINT8_MAX;
+
+    while(*Filter != '\0') {
+        if(strncmp_P(Filter, PSTR(MFCLASSIC_LOG_FILTER_CMD), sizeof(MFCLASSIC_LOG_FILTER_CMD) - 1) == 0) {
+            Filter = MifareClassicAppLogParseCommands(Filter + sizeof(MFCLASSIC_LOG_FILTER_CMD) - 1, NewFilter.Commands);
+        } else if(strncmp_P(Filter, PSTR(MFCLASSIC_LOG_FILTER_STATE), sizeof(MFCLASSIC_LOG_FILTER_STATE) - 1) == 0) {
+            Filter = MifareClassicAppLogParseStates(Filter + sizeof(MFCLASSIC_LOG_FILTER_STATE) - 1, &NewFilter.States);
+        } else if(strncmp_P(Filter, PSTR(MFCLASSIC_LOG_FILTER_DIR), sizeof(MFCLASSIC_LOG_FILTER_DIR) - 1) == 0) {
+            Filter = MifareClassicAppLogParseDirections(Filter + sizeof(MFCLASSIC_LOG_FILTER_DIR) - 1, &NewFilter.Directions);
+        } else if(strncmp_P(Filter, PSTR(MFCLASSIC_LOG_FILTER_LEN), sizeof(MFCLASSIC_LOG_FILTER_LEN) - 1) == 0) {
+            Filter = MifareClassicAppLogParseLength(Filter + sizeof(MFCLASSIC_LOG_FILTER_LEN) - 1, &NewFilter.MaxPayload);
+        } else {
+            return false;
+        }
+        if(Filter == NULL) {
+            return false;
+        }
+        if(*Filter == MFCLASSIC_LOG_FILTER_SEPARATOR) {
+            Filter++;
+        } else if(*Filter != '\0') {
+            return false;
+        }
+    }
+
+    /* Pending repetitions were counted under the former filter */
+    MifareClassicAppLogRepeats();
+    LogLastExchangeValid = false;
+    LogFilter = NewFilter;
+    LogFilterActive = true;
+    return true;
+}
+
+void MifareClassicAppLogGetFilter(char * Out, uint16_t MaxChars) {
+    uint16_t Length;
+    bool First = true;
+
+    if(!LogFilterActive) {
+        snprintf_P(Out, MaxChars, PSTR(MFCLASSIC_LOG_FILTER_ALL));
+        return;
+    }
+    /* Commands are shown as the compiled bitmap, command byte 0x00 in the LSB of the first byte */
+    Length = snprintf_P(Out, MaxChars, PSTR(MFCLASSIC_LOG_FILTER_CMDMAP));
+    Length += BufferToHexString(&Out[Length], MaxChars - Length, LogFilter.Commands, MFCLASSIC_LOG_FILTER_COMMANDS_LEN);
+    Length += snprintf_P(&Out[Length], MaxChars - Length, PSTR("%c" MFCLASSIC_LOG_FILTER_STATE), MFCLASSIC_LOG_FILTER_SEPARATOR);
+    for(uint8_t i = 0; i < ARRAY_COUNT(LogStateNames); i++) {
+        if( (LogFilter.States & (1 << i)) && (Length < MaxChars) ) {
+            if(!First) {
+                Out[Length++] = MFCLASSIC_LOG_FILTER_LIST_SEPARATOR;
+            }
+            Length += snprintf_P(&Out[Length], MaxChars - Length, LogStateNames[i]);
+            First = false;
+        }
+    }
+    if(Length < MaxChars) {
+        snprintf_P(&Out[Length], MaxChars - Length, PSTR("%c" MFCLASSIC_LOG_FILTER_DIR "%s%s%c" MFCLASSIC_LOG_FILTER_LEN "%u"),
+                   MFCLASSIC_LOG_FILTER_SEPARATOR,
+                   (LogFilter.Directions & MFCLASSIC_LOG_FILTER_DIR_READER) ? "R" : "",
+                   (LogFilter.Directions & MFCLASSIC_LOG_FILTER_DIR_TAG) ? "T" : "",
+                   MFCLASSIC_LOG_FILTER_SEPARATOR, LogFilter.MaxPayload);
+    }
+}
+
+/* Main loop side: write out a buffer handed over by the RF path */
+void MifareClassicAppLogTask(void) {
+    MifareClassicAppTask();
+    if(LogPendingBuffer != NULL) {
+        bool WriteHeader;
+        AppWorkingMemoryWrite(LogPendingBuffer, MFCLASSIC_LOG_MEM_LOG_HEADER_LEN+LogPendingAddress, LogPendingBytes);
+        if(LogPendingAddress == 0) {
+            /* The log starts over, what is behind belongs to the former pass */
             LogBytesWrote = 0;
+            LogFirstSequence = LogCommittedSequence = LogPendingStartSequence;
+            LogCursorSequence = LogFirstSequence;
+            LogCursorAddress = 0;
         }
-        /* write log */
-        AppWorkingMemoryWrite(LogLineBufferToWrite, MFCLASSIC_LOG_MEM_LOG_HEADER_LEN+LogBytesWrote, LogBytesToWrite);
-	/* update header */
-        LogBytesWrote += LogBytesToWrite;
+        if(LogPendingComplete > 0) {
+            LogBytesWrote = LogPendingAddress + LogPendingComplete;
+            LogCommittedSequence = LogPendingCompleteSequence;
+        }
+        /* The header is not rewritten for each buffer, see MifareClassicAppLogTick(),
+         * but at once when starting over as the former one does not fit anymore */
+        WriteHeader = (LogPendingAddress == 0) || (++LogFlushesSinceHeader >= MFCLASSIC_LOG_HEADER_FLUSH_INTERVAL);
+        /* Done with the LogPending fields, the codec interrupt may hand over the next buffer */
+        LogPendingBuffer = NULL;
+        if(WriteHeader) {
+            MifareClassicAppLogWriteHeader();
+        }
+    }
+}
+
+/* Write everything buffered so far, including the header */
+void MifareClassicAppLogFlush(void) {
+    bool Swapped;
+    MifareClassicAppFlush();
+    /* The active buffer belongs to the codec interrupt */
+    CodecProcessLock();
+    MifareClassicAppLogRepeats();
+    CodecProcessUnlock();
+    MifareClassicAppLogTask();
+    CodecProcessLock();
+    Swapped = MifareClassicAppLogSwapBuffers();
+    CodecProcessUnlock();
+    if(Swapped) {
+        MifareClassicAppLogTask();
+    }
+    if(LogFlushesSinceHeader > 0) {
         MifareClassicAppLogWriteHeader();
     }
 }
 
+void MifareClassicAppLogTick(void) {
+    /* No frame during the last tick: the field is gone or the reader idles,
+     * so flash latency does not matter and the log can be committed. */
+    if(!LogFrameSeen) {
+        MifareClassicAppLogFlush();
+    }
+    LogFrameSeen = false;
+}
+
 void MifareClassicAppLogStop(void) {
+    MifareClassicAppLogFlush();
     isLogEnabled = false;
     MifareClassicAppLogWriteHeader();
 }
@@ -502,6 +975,85 @@ void MifareClassicAppLogInit(void) {
     MifareClassicAppLogCheck();
     LogMaxBytes = ( AppWorkingMemorySize() - MFCLASSIC_LOG_MEM_LOG_HEADER_LEN );
     LogBytesBuffered = 0;
+    LogBufferComplete = 0;
+    LogBufferAddress = LogBytesWrote;
+    LogNextSequence = LogCommittedSequence;
+    LogBufferOverflow = false;
+    LogPendingBuffer = NULL;
+    LogFlushesSinceHeader = 0;
+    LogFrameSeen = false;
+    LogReaderHeld = false;
+    LogExchangeSkipped = false;
+    LogLastExchangeValid = false;
+    LogRepeatCount = 0;
+    MifareClassicAppLogBufferPlace();
+}
+
+/* Prepare streaming the records from sequence number Sequence on. Older records
+ * are skipped using the cursor left by the previous call, or by walking the log. */
+void MifareClassicAppLogSyncStart(uint32_t Sequence) {
+    uint8_t Flags = 0;
+    uint32_t Address = 0;
+    uint32_t RecordSequence = LogFirstSequence;
+
+    MifareClassicAppLogFlush();
+
+    if(Sequence < LogFirstSequence) {
+        Flags |= MFCLASSIC_LOG_SYNC_LOST;
+    } else if(Sequence > LogCommittedSequence) {
+        Flags |= MFCLASSIC_LOG_SYNC_RESET;
+    } else if( (Sequence == LogCursorSequence) && (LogCursorAddress <= LogBytesWrote) ) {
+        Address = LogCursorAddress;
+        RecordSequence = Sequence;
+    } else {
+        while(RecordSequence < Sequence) {
+            uint8_t recordHeader[MFCLASSIC_LOG_RECORD_HEADER_LEN];
+            if( ((Address + MFCLASSIC_LOG_RECORD_HEADER_LEN) > LogBytesWrote)
+                || !AppWorkingMemoryRead(recordHeader, MFCLASSIC_LOG_MEM_LOG_HEADER_LEN + Address, MFCLASSIC_LOG_RECORD_HEADER_LEN) ) {
+                /* Log does not match its header, send it all */
+                Flags |= MFCLASSIC_LOG_SYNC_RESET;
+                Address = 0;
+                RecordSequence = LogFirstSequence;
+                break;
+            }
+            Address += MifareClassicAppLogRecordLength(recordHeader);
+            RecordSequence++;
+        }
+    }
+
+    LogSyncAddress = Address;
+    LogSyncLength = LogBytesWrote - Address;
+    memset(LogSyncHeader, 0, MFCLASSIC_LOG_SYNC_HEADER_LEN);
+    LogSyncHeader[MFCLASSIC_LOG_SYNC_MAGIC_ADDR] = MFCLASSIC_LOG_SYNC_MAGIC;
+    LogSyncHeader[MFCLASSIC_LOG_SYNC_FORMAT_ADDR] = MFCLASSIC_LOG_MEM_FORMAT_BINARY;
+    LogSyncHeader[MFCLASSIC_LOG_SYNC_FLAGS_ADDR] = Flags;
+    Uint32ToBytes(RecordSequence, &LogSyncHeader[MFCLASSIC_LOG_SYNC_FIRSTSEQ_ADDR]);
+    Uint32ToBytes(LogSyncLength, &LogSyncHeader[MFCLASSIC_LOG_SYNC_LENGTH_ADDR]);
+    Uint32ToBytes(LogCommittedSequence, &LogSyncHeader[MFCLASSIC_LOG_SYNC_NEXTSEQ_ADDR]);
+
+    LogCursorSequence = LogCommittedSequence;
+    LogCursorAddress = LogBytesWrote;
+    MifareClassicAppLogWriteHeader();
+}
+
+/* XModem callback streaming the sync header and the records selected by MifareClassicAppLogSyncStart() */
+bool MifareClassicAppLogSyncXModem(void* Buffer, uint32_t BlockAddress, uint32_t ByteCount) {
+    uint8_t * ByteBuffer = (uint8_t *) Buffer;
+    uint32_t StreamLength = MFCLASSIC_LOG_SYNC_HEADER_LEN + LogSyncLength;
+
+    if(BlockAddress >= StreamLength) {
+        return false;
+    }
+    memset(ByteBuffer, MFCLASSIC_LOG_SYNC_PADDING, ByteCount);
+    ByteCount = MIN(ByteCount, StreamLength - BlockAddress);
+    while( (ByteCount > 0) && (BlockAddress < MFCLASSIC_LOG_SYNC_HEADER_LEN) ) {
+        *ByteBuffer++ = LogSyncHeader[BlockAddress++];
+        ByteCount--;
+    }
+    if(ByteCount > 0) {
+        AppWorkingMemoryRead(ByteBuffer, MFCLASSIC_LOG_MEM_LOG_HEADER_LEN + LogSyncAddress + (BlockAddress - MFCLASSIC_LOG_SYNC_HEADER_LEN), ByteCount);
+    }
+    return true;
 }
 
 void MifareClassicAppLogToggle(void) {
@@ -513,7 +1065,77 @@ void MifareClassicAppLogToggle(void) {
 }
 #endif
 
+/* Write-behind journal. Block writes from the reader are acknowledged once they are
+ * in RAM and committed to flash by MifareClassicAppTask() after the answer is out.
+ * Reads of the card memory see the journaled blocks. XModem transfers bypass it,
+ * so they are written through meanwhile. */
+static struct {
+    uint8_t Block;
+    uint8_t Data[MFCLASSIC_MEM_BYTES_PER_BLOCK];
+} Journal[MFCLASSIC_JOURNAL_BLOCKS];
+static uint8_t JournalCount = 0;
+
+/* Commit the oldest entry. The codec interrupt adds entries, so it waits meanwhile. */
+static void mfcJournalCommit(void) {
+    CodecProcessLock();
+    AppCardMemoryWrite(Journal[0].Data, (uint16_t) Journal[0].Block * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+    JournalCount--;
+    memmove(&Journal[0], &Journal[1], JournalCount * sizeof(Journal[0]));
+    CodecProcessUnlock();
+}
+
+static void mfcJournalWrite(uint8_t Block, const uint8_t * Data) {
+    uint8_t i;
+    if (XModemIsBusy()) {
+        /* A transfer works on the flash directly, so write through in order */
+        MifareClassicAppFlush();
+        AppCardMemoryWrite(Data, (uint16_t) Block * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+        return;
+    }
+    for (i = 0; i < JournalCount; i++) {
+        if (Journal[i].Block == Block) {
+            break;
+        }
+    }
+    if (i == MFCLASSIC_JOURNAL_BLOCKS) {
+        /* Full, make room synchronously */
+        mfcJournalCommit();
+        i--;
+    }
+    if (i == JournalCount) {
+        Journal[i].Block = Block;
+        JournalCount++;
+    }
+    memcpy(Journal[i].Data, Data, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+}
+
+static void mfcCardMemoryRead(void * Buffer, uint16_t Address, uint16_t ByteCount) {
+    AppCardMemoryRead(Buffer, Address, ByteCount);
+    for (uint8_t i = 0; i < JournalCount; i++) {
+        uint16_t BlockAddress = (uint16_t) Journal[i].Block * MFCLASSIC_MEM_BYTES_PER_BLOCK;
+        for (uint8_t j = 0; j < MFCLASSIC_MEM_BYTES_PER_BLOCK; j++) {
+            if ( (BlockAddress + j >= Address) && (BlockAddress + j < Address + ByteCount) ) {
+                ((uint8_t *) Buffer)[BlockAddress + j - Address] = Journal[i].Data[j];
+            }
+        }
+    }
+}
+
+void MifareClassicAppTask(void) {
+    /* One block at a time, and not while the codec waits for or sends an answer */
+    if ( (JournalCount > 0) && !ISO14443ACodecIsBusy() ) {
+        mfcJournalCommit();
+    }
+}
+
+void MifareClassicAppFlush(void) {
+    while (JournalCount > 0) {
+        mfcJournalCommit();
+    }
+}
+
 void MifareClassicAppReset(void) {
+    /* Called by the codec, the journal is left to MifareClassicAppTask() */
     State = STATE_IDLE;
 }
 
@@ -601,22 +1223,22 @@ void mfcHandleAuthenticationRequest(bool isNested, uint8_t * Buffer, uint16_t *
     CurrentAddress = SectorAddress / MFCLASSIC_MEM_BYTES_PER_BLOCK;
     //if (!AccessConditions[MEM_ACC_GPB_SIZE-1] ||(CurrentAddress != AccessAddress)) {
     /* Get access conditions from the sector trailor */
-    AppCardMemoryRead(AccessConditions, SectorAddress + AccessOffset, MFCLASSIC_MEM_ACC_GPB_SIZE);
+    mfcCardMemoryRead(AccessConditions, SectorAddress + AccessOffset, MFCLASSIC_MEM_ACC_GPB_SIZE);
     AccessAddress = CurrentAddress;
     //}
 
     /* Read UID and key from memory */
     if (is7BytesUID) {
-        AppCardMemoryRead(Uid, MFCLASSIC_MEM_UID_CL2_ADDRESS, MFCLASSIC_MEM_UID_CL2_SIZE);
+        mfcCardMemoryRead(Uid, MFCLASSIC_MEM_UID_CL2_ADDRESS, MFCLASSIC_MEM_UID_CL2_SIZE);
     } else {
-        AppCardMemoryRead(Uid, MFCLASSIC_MEM_UID_CL1_ADDRESS, MFCLASSIC_MEM_UID_CL1_SIZE);
+        mfcCardMemoryRead(Uid, MFCLASSIC_MEM_UID_CL1_ADDRESS, MFCLASSIC_MEM_UID_CL1_SIZE);
     }
-    AppCardMemoryRead(Key, KeyAddress, MFCLASSIC_MEM_KEY_SIZE);
+    mfcCardMemoryRead(Key, KeyAddress, MFCLASSIC_MEM_KEY_SIZE);
 
     /* Proceed with nested or regular authent */
     if(isNested) {
         uint8_t CardNonce[MFCLASSIC_MEM_NONCE_SIZE] = {0x01};
-        uint8_t CardNonceParity[MFCLASSIC_MEM_NONCE_SIZE];
+        uint8_t CardNonceParity;
          /* Precalculate the reader response from card-nonce */
         memcpy(ReaderResponse, CardNonce, MFCLASSIC_MEM_NONCE_SIZE);
         Crypto1PRNG(ReaderResponse, 64);
@@ -624,11 +1246,9 @@ void mfcHandleAuthenticationRequest(bool isNested, uint8_t * Buffer, uint16_t *
         memcpy(CardResponse, ReaderResponse, MFCLASSIC_MEM_NONCE_SIZE);
         Crypto1PRNG(CardResponse, 32);
         /* Setup crypto1 cipher for nested authentication. */
-        Crypto1Setup(Key, Uid, CardNonce, CardNonceParity);
-        for (uint8_t i=0; i<MFCLASSIC_MEM_NONCE_SIZE; i++) {
-            Buffer[i] = CardNonce[i];
-            Buffer[ISO14443A_BUFFER_PARITY_OFFSET + i] = CardNonceParity[i];
-        }
+        Crypto1Setup(Key, Uid, CardNonce, &CardNonceParity);
+        memcpy(Buffer, CardNonce, MFCLASSIC_MEM_NONCE_SIZE);
+        Buffer[ISO14443A_BUFFER_PARITY_OFFSET] = CardNonceParity;
         *RetValue = (MFCLASSIC_CMD_AUTH_RB_FRAME_SIZE * BITS_PER_BYTE) | ISO14443A_APP_CUSTOM_PARITY;
     } else {
         uint8_t CardNonce[MFCLASSIC_MEM_NONCE_SIZE] = {0x01, 0x20, 0x01, 0x45};
@@ -666,7 +1286,7 @@ void mfcEncryptBuffer(uint8_t * Output, uint8_t * Input, uint8_t Size) {
     for (uint8_t i=0; i < Size; i++) {
         uint8_t Plain = Input[i];
         Output[i] = Plain ^ Crypto1Byte();
-        Output[ISO14443A_BUFFER_PARITY_OFFSET + i] = ODD_PARITY(Plain) ^ Crypto1FilterOutput();
+        ISO14443ASetParityBit(&Output[ISO14443A_BUFFER_PARITY_OFFSET], i, ODD_PARITY(Plain) ^ Crypto1FilterOutput());
     }
 }
 
@@ -674,7 +1294,7 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
 #ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
     /* Log what comes from reader if logging enabled */
     if(isLogEnabled) {
-        MifareClassicAppLogBufferLine(Buffer, BitCount, MFCLASSIC_LOG_READER);
+        MifareClassicAppLogReaderFrame(Buffer, BitCount);
     }
 #endif
     /* Size of data (byte) we will send back to reader. Is main process return value */
@@ -709,12 +1329,12 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
                 Buffer[0] = MFCLASSIC_ACK_VALUE;
                 retSize = MFCLASSIC_ACK_NAK_FRAME_SIZE;
             } else if ( (Buffer[0] == MFCLASSIC_CMD_READ) || (Buffer[0] == MFCLASSIC_CMD_WRITE) ) {
-                if (!ISO14443ACheckCRCA(Buffer, MFCLASSIC_CMD_COMMON_FRAME_SIZE)) {
+                if (!ISO14443ACheckFrameCRCA(Buffer, MFCLASSIC_CMD_COMMON_FRAME_SIZE)) {
                     Buffer[0] = MFCLASSIC_NAK_TBOK_CRCKO;
                     retSize = MFCLASSIC_ACK_NAK_FRAME_SIZE;
                 } else if (Buffer[0] == MFCLASSIC_CMD_READ) {
                     /* Read command. Read data from memory and append CRCA. */
-                    AppCardMemoryRead(Buffer, (uint16_t) Buffer[1] * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+                    mfcCardMemoryRead(Buffer, (uint16_t) Buffer[1] * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
                     ISO14443AAppendCRCA(Buffer, MFCLASSIC_MEM_BYTES_PER_BLOCK);
                     retSize = (MFCLASSIC_CMD_READ_RESPONSE_FRAME_SIZE + ISO14443A_CRCA_SIZE)
                               * BITS_PER_BYTE;
@@ -732,10 +1352,12 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
             break; /* End of state CHINESE_IDLE */
 
         case STATE_CHINESE_WRITE:
-            if (ISO14443ACheckCRCA(Buffer, MFCLASSIC_MEM_BYTES_PER_BLOCK)) {
+            if (ISO14443ACheckFrameCRCA(Buffer, MFCLASSIC_MEM_BYTES_PER_BLOCK)) {
                 /* CRC check passed. Write data into memory and send ACK. */
                 if (!ActiveConfiguration.ReadOnly) {
-                    AppCardMemoryWrite(Buffer, CurrentAddress * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+                    uint8_t Ack = MFCLASSIC_ACK_VALUE;
+                    ISO14443ACodecSetProvisional(&Ack, NULL, MFCLASSIC_ACK_NAK_FRAME_SIZE);
+                    mfcJournalWrite(CurrentAddress, Buffer);
                 }
                 Buffer[0] = MFCLASSIC_ACK_VALUE;
             } else {
@@ -769,7 +1391,7 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
                     SAK = CardSAKValue;
                     NextState = STATE_ACTIVE;
                 }
-                AppCardMemoryRead(UidCLReadBuffer, UidMemAddr, UidReadSize);
+                mfcCardMemoryRead(UidCLReadBuffer, UidMemAddr, UidReadSize);
                 if (ISO14443ASelect(Buffer, &BitCount, UidCL, SAK)) {
                     AccessAddress = MFCLASSIC_MEM_INVALID_ADDRESS;
                     State = NextState;
@@ -782,7 +1404,7 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
                 /* 'Sequence 1' as per MF1S50YYX_V1, title 10.1.2 */
                 if ( is7BytesUID && (Buffer[0] == ISO14443A_CMD_SELECT_CL2) ) {
                     uint8_t UidCL[ISO14443A_CL_UID_SIZE];
-                    AppCardMemoryRead(UidCL, MFCLASSIC_MEM_UID_CL2_ADDRESS, MFCLASSIC_MEM_UID_CL2_SIZE);
+                    mfcCardMemoryRead(UidCL, MFCLASSIC_MEM_UID_CL2_ADDRESS, MFCLASSIC_MEM_UID_CL2_SIZE);
                     if (ISO14443ASelect(Buffer, &BitCount, UidCL, CardSAKValue)) {
                         State = STATE_ACTIVE;
                         isCascadeStepOnePassed = false;
@@ -791,7 +1413,7 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
                 /* 'Sequence 2' as per MF1S50YYX_V1, title 10.1.2 */
                 } else if (Buffer[0] == MFCLASSIC_CMD_READ) {
                     /* Read sector 0 / block 0 and send in plain */
-                    AppCardMemoryRead(Buffer, MFCLASSIC_MEM_S0B0_ADDRESS, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+                    mfcCardMemoryRead(Buffer, MFCLASSIC_MEM_S0B0_ADDRESS, MFCLASSIC_MEM_BYTES_PER_BLOCK);
                     ISO14443AAppendCRCA(Buffer, MFCLASSIC_MEM_BYTES_PER_BLOCK);
                     State = STATE_ACTIVE;
                     isCascadeStepOnePassed = false;
@@ -818,7 +1440,7 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
             }
 #endif
             if ( (Buffer[0] == MFCLASSIC_CMD_AUTH_A) || (Buffer[0] == MFCLASSIC_CMD_AUTH_B) ) {
-                if (ISO14443ACheckCRCA(Buffer, MFCLASSIC_CMD_AUTH_FRAME_SIZE)) {
+                if (ISO14443ACheckFrameCRCA(Buffer, MFCLASSIC_CMD_AUTH_FRAME_SIZE)) {
                     mfcHandleAuthenticationRequest(false, Buffer, &retSize);
                 } else {
                     Buffer[0] = MFCLASSIC_NAK_TBOK_CRCKO;
@@ -867,9 +1489,9 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
                     State = STATE_AUTHED_IDLE;
                     retSize = (MFCLASSIC_CMD_AUTH_BA_FRAME_SIZE * BITS_PER_BYTE) | ISO14443A_APP_CUSTOM_PARITY;
                 } else {
-		    /* Just reset on authentication error. */
+                    /* Just reset on authentication error. */
                     State = STATE_IDLE;
-		    /* In detection mode, communication can continue. */
+                    /* In detection mode, communication can continue. */
                     if(isDetectionEnabled)
                         State = STATE_ACTIVE;
 
@@ -895,10 +1517,10 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
                         /* Read command. Read data from memory and append CRCA. */
                         /* Sector trailor? Use access conditions! */
 
-			if ((Buffer[1] < 128 && (Buffer[1] & 3) == 3) || ((Buffer[1] & 15) == 15)) {
-			    uint8_t Acc;
-			    CurrentAddress = Buffer[1];
-			    /* Decode the access conditions */
+                        if ((Buffer[1] < 128 && (Buffer[1] & 3) == 3) || ((Buffer[1] & 15) == 15)) {
+                            uint8_t Acc;
+                            CurrentAddress = Buffer[1];
+                            /* Decode the access conditions */
                             Acc = abTrailorAccessConditions[ GetAccessCondition(CurrentAddress) ][ KeyInUse ];
 
                             /* Prepare empty Block */
@@ -910,7 +1532,7 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
                             /* Access conditions were already read during authentication! */
                             Buffer[MFCLASSIC_MEM_KEY_SIZE + MFCLASSIC_MEM_ACC_GPB_SIZE - 1] = AccessConditions[MFCLASSIC_MEM_ACC_GPB_SIZE - 1];
 
-			    /* Access conditions are already known */
+                            /* Access conditions are already known */
                             if (Acc & MFCLASSIC_ACC_TRAILOR_READ_ACC) {
                                 Buffer[MFCLASSIC_MEM_KEY_SIZE]     = AccessConditions[0];
                                 Buffer[MFCLASSIC_MEM_KEY_SIZE + 1] = AccessConditions[1];
@@ -919,12 +1541,12 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
 
                             /* Key B is readable in some rare cases */
                             if (Acc & MFCLASSIC_ACC_TRAILOR_READ_KEYB) {
-                                AppCardMemoryRead(Buffer + MFCLASSIC_MEM_BYTES_PER_BLOCK - MFCLASSIC_MEM_KEY_SIZE,
+                                mfcCardMemoryRead(Buffer + MFCLASSIC_MEM_BYTES_PER_BLOCK - MFCLASSIC_MEM_KEY_SIZE,
                                             (uint16_t)(CurrentAddress | 3) * MFCLASSIC_MEM_BYTES_PER_BLOCK + MFCLASSIC_MEM_BYTES_PER_BLOCK - MFCLASSIC_MEM_KEY_SIZE,
                                             MFCLASSIC_MEM_KEY_SIZE);
                             }
                         } else {
-			    AppCardMemoryRead(Buffer, (uint16_t) Buffer[1] * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+                            mfcCardMemoryRead(Buffer, (uint16_t) Buffer[1] * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
                         }
                         ISO14443AAppendCRCA(Buffer, MFCLASSIC_MEM_BYTES_PER_BLOCK);
                         /* Encrypt and calculate parity bits. */
@@ -944,13 +1566,16 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
                             State = STATE_WRITE;
                             Buffer[0] = MFCLASSIC_ACK_VALUE ^ Crypto1Nibble();
                         } else if (Buffer[0] == MFCLASSIC_CMD_TRANSFER) {
-                            /* Write back the global block buffer to the desired block address */
+                            /* Write back the global block buffer to the desired block address.
+                             * The ACK is ready before, so it can go out on time if the journal
+                             * has to make room in flash. */
+                            Buffer[0] = MFCLASSIC_ACK_VALUE ^ Crypto1Nibble();
                             if (!ActiveConfiguration.ReadOnly) {
-                                AppCardMemoryWrite(BlockBuffer, (uint16_t) Buffer[1] * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+                                ISO14443ACodecSetProvisional(Buffer, NULL, MFCLASSIC_ACK_NAK_FRAME_SIZE);
+                                mfcJournalWrite(CurrentAddress, BlockBuffer);
                             } else {
                                 /* In read only mode, silently ignore the write */
                             }
-                            Buffer[0] = MFCLASSIC_ACK_VALUE ^ Crypto1Nibble();
                         }
                         retSize = MFCLASSIC_ACK_NAK_FRAME_SIZE;
                     } else if (Buffer[0] == MFCLASSIC_CMD_DECREMENT) {
@@ -989,11 +1614,15 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
             /* We could also get an encrypted HALT... */
             if ( !mfcHandleHaltCommand(Buffer, &retSize) ) {
                 if (ISO14443ACheckCRCA(Buffer, MFCLASSIC_MEM_BYTES_PER_BLOCK)) {
+                    /* The ACK is encrypted before the write, so it can go out on time if
+                     * the journal has to make room in flash */
+                    uint8_t Ack = MFCLASSIC_ACK_VALUE ^ Crypto1Nibble();
                     /* Silently ignore in ReadOnly mode */
                     if (!ActiveConfiguration.ReadOnly) {
-                        AppCardMemoryWrite(Buffer, CurrentAddress * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+                        ISO14443ACodecSetProvisional(&Ack, NULL, MFCLASSIC_ACK_NAK_FRAME_SIZE);
+                        mfcJournalWrite(CurrentAddress, Buffer);
                     }
-                    Buffer[0] = MFCLASSIC_ACK_VALUE ^ Crypto1Nibble();
+                    Buffer[0] = Ack;
                 } else {
                     Buffer[0] = MFCLASSIC_NAK_TBOK_CRCKO ^ Crypto1Nibble();
                 }
@@ -1015,7 +1644,7 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
             /* We could also get an encrypted HALT... */
             if ( !mfcHandleHaltCommand(Buffer, &retSize) ) {
                 if (ISO14443ACheckCRCA(Buffer, MFCLASSIC_MEM_VALUE_SIZE)) {
-                    AppCardMemoryRead(BlockBuffer, (uint16_t) CurrentAddress * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
+                    mfcCardMemoryRead(BlockBuffer, (uint16_t) CurrentAddress * MFCLASSIC_MEM_BYTES_PER_BLOCK, MFCLASSIC_MEM_BYTES_PER_BLOCK);
                     if (CheckValueIntegrity(BlockBuffer)) {
                         uint32_t ParamValue;
                         uint32_t BlockValue;
@@ -1053,7 +1682,7 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
 #ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
     /* Log what goes from tag if logging enabled */
     if(isLogEnabled) {
-        MifareClassicAppLogBufferLine(Buffer, (retSize & ISO14443A_APP_CUSTOM_PARITY) ? (retSize & ~ISO14443A_APP_CUSTOM_PARITY) : (retSize), MFCLASSIC_LOG_TAG);
+        MifareClassicAppLogTagFrame(Buffer, (retSize & ISO14443A_APP_CUSTOM_PARITY) ? (retSize & ~ISO14443A_APP_CUSTOM_PARITY) : (retSize));
     }
 #endif
     return retSize;
@@ -1061,14 +1690,16 @@ uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount) {
 
 void MifareClassicGetUid(ConfigurationUidType Uid) {
     if (is7BytesUID) {
-        AppCardMemoryRead(&Uid[0], MFCLASSIC_MEM_UID_CL1_ADDRESS, MFCLASSIC_MEM_UID_CL1_SIZE-1);
-        AppCardMemoryRead(&Uid[3], MFCLASSIC_MEM_UID_CL2_ADDRESS, MFCLASSIC_MEM_UID_CL2_SIZE);
+        mfcCardMemoryRead(&Uid[0], MFCLASSIC_MEM_UID_CL1_ADDRESS, MFCLASSIC_MEM_UID_CL1_SIZE-1);
+        mfcCardMemoryRead(&Uid[3], MFCLASSIC_MEM_UID_CL2_ADDRESS, MFCLASSIC_MEM_UID_CL2_SIZE);
     } else {
-        AppCardMemoryRead(Uid, MFCLASSIC_MEM_UID_CL1_ADDRESS, MFCLASSIC_MEM_UID_CL1_SIZE);
+        mfcCardMemoryRead(Uid, MFCLASSIC_MEM_UID_CL1_ADDRESS, MFCLASSIC_MEM_UID_CL1_SIZE);
     }
 }
 
 void MifareClassicSetUid(ConfigurationUidType Uid) {
+    /* A journaled block 0 would overwrite the new UID */
+    MifareClassicAppFlush();
     if (is7BytesUID) {
         AppCardMemoryWrite(Uid, MFCLASSIC_MEM_UID_CL1_ADDRESS, ActiveConfiguration.UidSize);
     } else {
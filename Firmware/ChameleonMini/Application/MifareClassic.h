@@ -53,6 +53,7 @@
 #define MFCLASSIC_MEM_NONCE_SIZE                4
 #define MFCLASSIC_ACK_NAK_FRAME_SIZE            4
 #define MFCLASSIC_ACK_VALUE                     0x0A
+#define MFCLASSIC_JOURNAL_BLOCKS                4 /* Written blocks held in RAM until committed to flash */
 
 /* Unreferenced NAK values in RevG original code
 #define NAK_INVALID_ARG                         0x00
@@ -198,35 +199,75 @@ C1 C2 C3     read     write     increment     decrement,
 #endif
 
 #ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
-#define MFCLASSIC_LOG_LINE_START                0x3E
-#define MFCLASSIC_LOG_LINE_END                  0x3B
-#define MFCLASSIC_LOG_TAB                       0x09
-#define MFCLASSIC_LOG_EOL_CR                    0x0D
-#define MFCLASSIC_LOG_EOL_LF                    0x0A
-#define MFCLASSIC_LOG_EOS                       0x00
-#define MFCLASSIC_LOG_SEPARATOR                 0x21
-#define MFCLASSIC_LOG_READER                    0x52
-#define MFCLASSIC_LOG_TAG                       0x54
-#define MFCLASSIC_LOG_MEM_CHAR_LEN              1
 #define MFCLASSIC_LOG_MEM_STATUS_CANARY_ADDR    MFCLASSIC_LOG_MEM_LOG_HEADER_ADDR
 #define MFCLASSIC_LOG_MEM_STATUS_CANARY         0x71
 #define MFCLASSIC_LOG_MEM_STATUS_RESET          0x70
 #define MFCLASSIC_LOG_MEM_STATUS_LEN            1
+#define MFCLASSIC_LOG_MEM_FORMAT_ADDR           1
+#define MFCLASSIC_LOG_MEM_FORMAT_BINARY         0x03
+#define MFCLASSIC_LOG_MEM_FIRSTSEQ_ADDR         4 // Sequence number of the record at the start of the log
+#define MFCLASSIC_LOG_MEM_COMMITSEQ_ADDR        8 // Sequence number of the next record to be written
 #define MFCLASSIC_LOG_MEM_WROTEBYTES_ADDR       12
 #define MFCLASSIC_LOG_MEM_WROTEBYTES_LEN        sizeof(uint32_t)
+#define MFCLASSIC_LOG_MEM_CURSORSEQ_ADDR        16 // Where the last LOGSYNC ended
+#define MFCLASSIC_LOG_MEM_CURSORADDR_ADDR       20
 #define MFCLASSIC_LOG_MEM_LOG_HEADER_ADDR       0
-#define MFCLASSIC_LOG_MEM_LOG_HEADER_LEN        16
-#define MFCLASSIC_LOG_MEM_LINE_BUFFER_LEN       256
-#define MFCLASSIC_LOG_MEM_LINE_START_ADDR       0
-#define MFCLASSIC_LOG_MEM_LINE_TIMESTAMP_LEN    sizeof(uint16_t)
-#define MFCLASSIC_LOG_LINE_OVERHEAD             (MFCLASSIC_LOG_MEM_LINE_TIMESTAMP_LEN+MFCLASSIC_LOG_MEM_CHAR_LEN*10)
+#define MFCLASSIC_LOG_MEM_LOG_HEADER_LEN        32
+#define MFCLASSIC_LOG_FLASH_PAGE_SIZE           FLASH_BYTES_PER_PAGE_MIN // Flash is configured for binary page size
+#define MFCLASSIC_LOG_MEM_RECORD_BUFFER_LEN     (MFCLASSIC_LOG_FLASH_PAGE_SIZE / 2) // Divides the page. There are two of them, on 4 KB of SRAM
+#define MFCLASSIC_LOG_HEADER_FLUSH_INTERVAL     8 // Flushes between header updates while the reader is busy
+/* Binary log record, decoded on the host by Software/Tools/mfc_log_decode.py:
+ * timestamp (4 bytes LE, see SystemGetTimestamp) | info (1 byte) | bit count (2 bytes LE) | frame bytes */
+#define MFCLASSIC_LOG_RECORD_TIMESTAMP_OFFSET   0
+#define MFCLASSIC_LOG_RECORD_INFO_OFFSET        4
+#define MFCLASSIC_LOG_RECORD_BITCOUNT_OFFSET    5
+#define MFCLASSIC_LOG_RECORD_HEADER_LEN         7
+/* Info byte: direction in the MSB, truncation flag, state id or marker below */
+#define MFCLASSIC_LOG_READER                    0x00
+#define MFCLASSIC_LOG_TAG                       0x80
+#define MFCLASSIC_LOG_TRUNCATED                 0x40 // Frame cut to the LOGFILTER length, bit count is the stored one
+#define MFCLASSIC_LOG_STATE_MASK                0x3F
 #define MFCLASSIC_LOG_BUFFER_OVERFLOW           0x0F
+/* Repeat record: the bit count field holds how often the previous exchange was seen again,
+ * the timestamp is the one of the last repetition */
+#define MFCLASSIC_LOG_REPEAT                    0x0E
+#define MFCLASSIC_LOG_EXCHANGE_FRAME_LEN        18 // Longest frame considered for collapsing
+/* LOGSYNC= stream: this header, followed by the records from the requested sequence number on */
+#define MFCLASSIC_LOG_SYNC_MAGIC_ADDR           0
+#define MFCLASSIC_LOG_SYNC_MAGIC                0x4C
+#define MFCLASSIC_LOG_SYNC_FORMAT_ADDR          1
+#define MFCLASSIC_LOG_SYNC_FLAGS_ADDR           2
+#define MFCLASSIC_LOG_SYNC_FIRSTSEQ_ADDR        4 // Sequence number of the first record sent
+#define MFCLASSIC_LOG_SYNC_LENGTH_ADDR          8 // Bytes of records following the header
+#define MFCLASSIC_LOG_SYNC_NEXTSEQ_ADDR         12 // Sequence number to ask for next time
+#define MFCLASSIC_LOG_SYNC_HEADER_LEN           16
+#define MFCLASSIC_LOG_SYNC_LOST                 0x01 // Requested records were overwritten already
+#define MFCLASSIC_LOG_SYNC_RESET                0x02 // Requested sequence number is unknown, the log was restarted
+#define MFCLASSIC_LOG_SYNC_PADDING              0x1A
+/* LOGFILTER= syntax */
+#define MFCLASSIC_LOG_FILTER_ALL                "ALL"
+#define MFCLASSIC_LOG_FILTER_CMD                "CMD:"
+#define MFCLASSIC_LOG_FILTER_CMDMAP             "CMDMAP:"
+#define MFCLASSIC_LOG_FILTER_STATE              "STATE:"
+#define MFCLASSIC_LOG_FILTER_DIR                "DIR:"
+#define MFCLASSIC_LOG_FILTER_LEN                "LEN:"
+#define MFCLASSIC_LOG_FILTER_SEPARATOR          ','
+#define MFCLASSIC_LOG_FILTER_LIST_SEPARATOR     '+'
+#define MFCLASSIC_LOG_FILTER_MASK_SEPARATOR     '/'
+#define MFCLASSIC_LOG_FILTER_NAME_END           "+,"
+#define MFCLASSIC_LOG_FILTER_READER_CHAR        'R'
+#define MFCLASSIC_LOG_FILTER_TAG_CHAR           'T'
+#define MFCLASSIC_LOG_FILTER_DIR_READER         0x01
+#define MFCLASSIC_LOG_FILTER_DIR_TAG            0x02
+#define MFCLASSIC_LOG_FILTER_COMMANDS_LEN       (256 / BITS_PER_BYTE)
 #endif
 
 void MifareClassicAppInit1K(void);
 void MifareClassicAppInit4K(void);
 void MifareClassicAppInitMini(void);
 void MifareClassicAppReset(void);
+void MifareClassicAppTask(void);
+void MifareClassicAppFlush(void);
 
 uint16_t MifareClassicAppProcess(uint8_t* Buffer, uint16_t BitCount);
 
@@ -251,8 +292,14 @@ void MifareClassicAppBruteToggle(void);
 
 #ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
 void MifareClassicAppLogInit(void);
-void MifareClassicAppLogWriteLines(void);
+void MifareClassicAppLogTask(void);
+void MifareClassicAppLogTick(void);
+void MifareClassicAppLogFlush(void);
 void MifareClassicAppLogToggle(void);
+bool MifareClassicAppLogSetFilter(const char * Filter);
+void MifareClassicAppLogGetFilter(char * Out, uint16_t MaxChars);
+void MifareClassicAppLogSyncStart(uint32_t Sequence);
+bool MifareClassicAppLogSyncXModem(void* Buffer, uint32_t BlockAddress, uint32_t ByteCount);
 #endif
 
 #endif /* MIFARECLASSIC_H_ */
@@ -11,10 +11,11 @@
 #define NTAG21x_H_
 #include "Application.h"
 #include "ISO14443-3A.h"
+#include "Type2Tag.h"
 
-#define NTAG21x_UID_SIZE ISO14443A_UID_SIZE_DOUBLE //7 bytes UID
+#define NTAG21x_UID_SIZE TYPE2TAG_UID_SIZE //7 bytes UID
 
-#define NTAG21x_PAGE_SIZE 4 //bytes per page
+#define NTAG21x_PAGE_SIZE TYPE2TAG_PAGE_SIZE //bytes per page
 #define NTAG213_PAGES 45 //45 pages total for ntag213, from 0 to 44
 #define NTAG215_PAGES 135 //135 pages total for ntag215, from 0 to 134
 #define NTAG216_PAGES 231 //231 pages total for ntag216, from 0 to 230
@@ -24,22 +25,8 @@
 #define NTAG216_MEM_SIZE ( NTAG21x_PAGE_SIZE * NTAG216_PAGES )
 
 void NTAG213AppInit(void);
-/* void NTAG213AppReset(void); */
-
 void NTAG215AppInit(void);
-/* void NTAG215AppReset(void); */
-
 void NTAG216AppInit(void);
-/* void NTAG216AppReset(void); */
-void NTAG21xAppReset(void);
-
-uint16_t NTAG21xAppProcess(uint8_t *Buffer, uint16_t BitCount);
-/* uint16_t NTAG213AppProcess(uint8_t *Buffer, uint16_t BitCount); */
-/* uint16_t NTAG215AppProcess(uint8_t *Buffer, uint16_t BitCount); */
-/* uint16_t NTAG216AppProcess(uint8_t *Buffer, uint16_t BitCount); */
-
-void NTAG21xGetUid(ConfigurationUidType Uid);
-void NTAG21xSetUid(ConfigurationUidType Uid);
 
 #endif
 
@@ -0,0 +1,777 @@
+/*
+ * Type2Tag.c
+ *
+ *  Common engine for NFC Forum Type 2 tags, merged from the former
+ *  MifareUltralight.c (skuser) and NTAG21x.c (Giovanni Cammisa) state machines.
+ *  Still missing support for:
+ *      -The management of dynamic lock bytes
+ *      -Bruteforce protection (AUTHLIM COUNTER)
+ */
+
+#if ((defined CONFIG_MF_ULTRALIGHT_SUPPORT) || (defined CONFIG_NTAG213_SUPPORT) || (defined CONFIG_NTAG215_SUPPORT) || (defined CONFIG_NTAG216_SUPPORT))
+
+#include <stddef.h>
+#include "Type2Tag.h"
+#include "ISO14443-3A.h"
+#include "../Codec/ISO14443-2A.h"
+#include "../Memory/Memory.h"
+
+#define ATQA_VALUE              0x0044
+#define SAK_CL1_VALUE           ISO14443A_SAK_INCOMPLETE
+#define SAK_CL2_VALUE           ISO14443A_SAK_COMPLETE_NOT_COMPLIANT
+
+#define ACK_VALUE               0x0A
+#define ACK_FRAME_SIZE          4 /* Bits */
+#define NAK_INVALID_ARG         0x00
+#define NAK_CRC_ERROR           0x01
+#define NAK_CTR_ERROR           0x04
+#define NAK_EEPROM_ERROR        0x05
+#define NAK_FRAME_SIZE          4
+
+/* ISO commands */
+#define CMD_HALT                0x50
+/* EV0 commands */
+#define CMD_READ                0x30
+#define CMD_READ_FRAME_SIZE     2 /* without CRC bytes */
+#define CMD_WRITE               0xA2
+#define CMD_WRITE_FRAME_SIZE    6 /* without CRC bytes */
+#define CMD_COMPAT_WRITE        0xA0
+#define CMD_COMPAT_WRITE_FRAME_SIZE 2
+/* EV1 and NTAG commands */
+#define CMD_GET_VERSION         0x60
+#define CMD_FAST_READ           0x3A
+#define CMD_READ_CNT            0x39
+#define CMD_INCREMENT_CNT       0xA5
+#define CMD_PWD_AUTH            0x1B
+#define CMD_READ_SIG            0x3C
+#define CMD_CHECK_TEARING_EVENT 0x3E
+#define CMD_VCSL                0x4B
+
+/* Tag memory layout; addresses and sizes in bytes */
+#define UID_CL1_ADDRESS         0x00
+#define UID_CL1_SIZE            3
+#define UID_BCC1_ADDRESS        0x03
+#define UID_CL2_ADDRESS         0x04
+#define UID_CL2_SIZE            4
+#define UID_BCC2_ADDRESS        0x08
+#define CONF_AUTH0_OFFSET       0x03
+#define CONF_ACCESS_OFFSET      0x04
+#define CONF_VCTID_OFFSET       0x05
+#define CONF_PASSWORD_OFFSET    0x08
+#define CONF_PACK_OFFSET        0x0C
+
+#define CONF_ACCESS_PROT        0x80
+#define CONF_ACCESS_CNFLCK      0x40
+
+#define CNT_COUNT               3
+#define CNT_MAX                 (CNT_COUNT - 1)
+#define CNT_SIZE                3
+#define CNT_MAX_VALUE           0x00FFFFFF
+#define TEARING_SIZE            1
+#define TEARING_VALID           0xBD
+
+#define COUNTER_COMMANDS        (TYPE2TAG_CMD_READ_CNT | TYPE2TAG_CMD_INCREMENT_CNT | TYPE2TAG_CMD_CHECK_TEARING)
+
+/* A sniffed password is written once the reader stays quiet for a tick, or after this many ticks at most */
+#define PERSIST_MAX_TICKS       10
+#define RECORD_CHECK_SEED       0xA5
+
+#define BYTES_PER_READ          16
+#define PAGE_READ_MIN           0x00
+
+#define BYTES_PER_WRITE         4
+#define PAGE_WRITE_MIN          0x02
+#define PAGE_LOCK_BITS          0x02
+#define PAGE_OTP                0x03
+
+/* FAST_READ answers must leave room for CRC and not spill into the parity area */
+#define BYTES_PER_FAST_READ_MAX (ISO14443A_BUFFER_PARITY_OFFSET - ISO14443A_CRCA_SIZE)
+
+#define PACK_SIZE               2
+
+/* Data stored past the user pages by the extended dump format; offsets in pages */
+#define VERSION_OFFSET_PAGES    3
+#define SIGNATURE_OFFSET_PAGES  5
+#define SIGNATURE_LENGTH        32
+#define SIGNATURE_DEFAULT_BYTE  0xCA
+
+static enum {
+    STATE_HALT,
+    STATE_IDLE,
+    STATE_READY1,
+    STATE_READY2,
+    STATE_ACTIVE
+} State;
+
+static Type2TagDescriptorType Tag;
+static bool FromHalt = false;
+static bool ArmedForCompatWrite;
+static uint8_t CompatWritePageAddress;
+static bool Authenticated;
+static uint8_t FirstAuthenticatedPage;
+static bool ReadAccessProtected;
+static uint16_t CardATQAValue;
+static uint8_t CardSAKValue;
+
+/* Counters and tearing flags are served from RAM. Changes are persisted by
+ * Type2TagAppTask() once the codec is idle, by appending a full snapshot to a ring of
+ * records in working memory. A change arriving while a record is still pending writes
+ * it right away, so power loss can only lose the change in flight. */
+typedef struct {
+    uint16_t Sequence;
+    uint8_t Counter[CNT_COUNT][CNT_SIZE];
+    uint8_t Tearing[CNT_COUNT];
+    uint8_t Reserved;
+    uint8_t Check;
+} CounterRecordType;
+
+static CounterRecordType Counters;
+static bool CountersPersistent;
+static volatile bool CountersDirty;
+static uint8_t LastPassword[TYPE2TAG_PWD_SIZE];
+static bool PasswordDirty;
+static bool FrameSeen;
+static uint8_t PersistAge;
+
+INLINE uint16_t ConfigAreaAddress(void)
+{
+    return (uint16_t) Tag.ConfigAreaPage * TYPE2TAG_PAGE_SIZE;
+}
+
+INLINE uint16_t ExtraAreaAddress(uint8_t PageOffset)
+{
+    return ((uint16_t) Tag.PageCount + PageOffset) * TYPE2TAG_PAGE_SIZE;
+}
+
+/* Consecutive records alternate between both banks of the journal */
+INLINE uint16_t CounterRecordAddress(uint16_t Sequence)
+{
+    return TYPE2TAG_CNT_JOURNAL_ADDRESS + (Sequence & 0x01) * TYPE2TAG_CNT_BANK_SIZE
+            + ((Sequence >> 1) % TYPE2TAG_CNT_BANK_RECORDS) * TYPE2TAG_CNT_RECORD_SIZE;
+}
+
+static uint8_t CounterRecordCheck(const CounterRecordType* Record)
+{
+    const uint8_t* Bytes = (const uint8_t*) Record;
+    uint8_t Check = RECORD_CHECK_SEED;
+
+    /* Seeded so that neither an erased nor a zeroed record is valid */
+    for (uint8_t i = 0; i < offsetof(CounterRecordType, Check); i++) {
+        Check += Bytes[i];
+    }
+    return Check;
+}
+
+static void CountersLoad(void)
+{
+    CounterRecordType Record;
+    bool Found = false;
+
+    /* Start with the values of the dump, if it carries counter pages */
+    memset(&Counters, 0, sizeof(CounterRecordType));
+    for (uint8_t i = 0; i < CNT_COUNT; i++) {
+        AppCardMemoryRead(Counters.Counter[i], ExtraAreaAddress(i), CNT_SIZE);
+        AppCardMemoryRead(&Counters.Tearing[i], ExtraAreaAddress(i) + CNT_SIZE, TEARING_SIZE);
+    }
+
+    /* The most recent valid journal record wins */
+    CountersPersistent = (AppWorkingMemorySize() >= TYPE2TAG_WORKING_MEM_SIZE);
+    if (CountersPersistent) {
+        for (uint16_t Address = TYPE2TAG_CNT_JOURNAL_ADDRESS; Address < TYPE2TAG_WORKING_MEM_SIZE; Address += TYPE2TAG_CNT_RECORD_SIZE) {
+            if (AppWorkingMemoryRead(&Record, Address, sizeof(CounterRecordType))
+                && (Record.Check == CounterRecordCheck(&Record))
+                && (!Found || (int16_t) (Record.Sequence - Counters.Sequence) > 0)) {
+                Counters = Record;
+                Found = true;
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < CNT_COUNT; i++) {
+        if (Counters.Tearing[i] == 0) {
+            Counters.Tearing[i] = TEARING_VALID;
+        }
+    }
+}
+
+/* Appends a snapshot of the counters to the journal */
+static void CountersPersist(void)
+{
+    CountersDirty = false;
+    if (CountersPersistent) {
+        Counters.Sequence++;
+        Counters.Check = CounterRecordCheck(&Counters);
+        AppWorkingMemoryWrite(&Counters, CounterRecordAddress(Counters.Sequence), sizeof(CounterRecordType));
+    }
+}
+
+static bool CounterAdd(uint8_t CounterId, uint32_t Addend)
+{
+    uint8_t* Counter = Counters.Counter[CounterId];
+    uint32_t Value = ((uint32_t)Counter[0]) | ((uint32_t)Counter[1] << 8) | ((uint32_t)Counter[2] << 16);
+
+    /* Add and check for overflow */
+    Value += Addend;
+    if (Value > CNT_MAX_VALUE) {
+        return false;
+    }
+    if (Addend != 0) {
+        Counter[0] = (uint8_t) Value;
+        Counter[1] = (uint8_t) (Value >> 8);
+        Counter[2] = (uint8_t) (Value >> 16);
+    }
+    return true;
+}
+
+void Type2TagAppInit(const Type2TagDescriptorType* Descriptor)
+{
+    memcpy_P(&Tag, Descriptor, sizeof(Type2TagDescriptorType));
+
+    State = STATE_IDLE;
+    FromHalt = false;
+    Authenticated = false;
+    ArmedForCompatWrite = false;
+    CardATQAValue = ATQA_VALUE;
+    CardSAKValue = SAK_CL1_VALUE;
+
+    /* Default values: no page is password protected */
+    FirstAuthenticatedPage = 0xFF;
+    ReadAccessProtected = false;
+
+    if (Tag.ConfigAreaPage != TYPE2TAG_NO_CONFIG_AREA) {
+        uint8_t Access;
+
+        /* Fetch some of the configuration into RAM */
+        AppCardMemoryRead(&FirstAuthenticatedPage, ConfigAreaAddress() + CONF_AUTH0_OFFSET, 1);
+        AppCardMemoryRead(&Access, ConfigAreaAddress() + CONF_ACCESS_OFFSET, 1);
+        ReadAccessProtected = !!(Access & CONF_ACCESS_PROT);
+    }
+
+    /* Bring the last sniffed password and the counters into RAM */
+    if (!(Tag.Commands & TYPE2TAG_PWD_SNIFF) || !AppWorkingMemoryRead(LastPassword, TYPE2TAG_PWD_ADDRESS, TYPE2TAG_PWD_SIZE)) {
+        memset(LastPassword, 0, TYPE2TAG_PWD_SIZE);
+    }
+    PasswordDirty = false;
+    CountersDirty = false;
+    if (Tag.Commands & COUNTER_COMMANDS) {
+        CountersLoad();
+    } else {
+        CountersPersistent = false;
+    }
+    FrameSeen = false;
+    PersistAge = 0;
+}
+
+void Type2TagAppReset(void)
+{
+    State = STATE_IDLE;
+}
+
+/* Write back whatever is only held in RAM */
+void Type2TagAppFlush(void)
+{
+    /* PWD_AUTH and INCREMENT_CNT may change them meanwhile */
+    CodecProcessLock();
+    if (PasswordDirty) {
+        AppWorkingMemoryWrite(LastPassword, TYPE2TAG_PWD_ADDRESS, TYPE2TAG_PWD_SIZE);
+        PasswordDirty = false;
+    }
+    if (CountersDirty) {
+        CountersPersist();
+    }
+    CodecProcessUnlock();
+    PersistAge = 0;
+}
+
+void Type2TagAppTask(void)
+{
+    /* Not while the codec waits for or sends an answer */
+    if (CountersDirty && !ISO14443ACodecIsBusy()) {
+        CodecProcessLock();
+        if (CountersDirty) {
+            CountersPersist();
+        }
+        CodecProcessUnlock();
+    }
+}
+
+void Type2TagAppTick(void)
+{
+    if (PasswordDirty) {
+        /* Keep the flash out of the way while the reader is talking to us,
+         * but do not hold changes back forever under continuous traffic */
+        if (!FrameSeen || ++PersistAge >= PERSIST_MAX_TICKS) {
+            Type2TagAppFlush();
+        }
+    }
+    FrameSeen = false;
+}
+
+static bool VerifyAuthentication(uint8_t PageAddress)
+{
+    /* If authenticated, no verification needed */
+    if (Authenticated) {
+        return true;
+    }
+    /* Otherwise, verify the accessed page is below the limit */
+    return PageAddress < FirstAuthenticatedPage;
+}
+
+/* Perform access verification and commit data if passed */
+static void AppWritePage(uint8_t PageAddress, uint8_t* const Buffer)
+{
+    if (!ActiveConfiguration.ReadOnly) {
+        if (PageAddress == PAGE_LOCK_BITS || PageAddress == PAGE_OTP) {
+            /* OTP page and static lock bits can not be reset to zero */
+            uint8_t PageBytes[TYPE2TAG_PAGE_SIZE];
+            AppCardMemoryRead(PageBytes, PageAddress * TYPE2TAG_PAGE_SIZE, TYPE2TAG_PAGE_SIZE);
+            /* First two bytes of page with locks are not rewritable */
+            if (PageAddress == PAGE_LOCK_BITS) {
+                Buffer[0] = Buffer[1] = 0;
+            }
+            for (uint8_t i = 0; i < TYPE2TAG_PAGE_SIZE; i++) {
+                Buffer[i] |= PageBytes[i];
+            }
+        }
+        AppCardMemoryWrite(Buffer, PageAddress * TYPE2TAG_PAGE_SIZE, TYPE2TAG_PAGE_SIZE);
+    } else {
+        /* If the chameleon is in read only mode, it silently
+        * ignores any attempt to write data. */
+    }
+}
+
+static uint16_t AppCmdRead(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    uint8_t PageAddress = Buffer[1];
+    uint8_t PageLimit = Tag.PageCount;
+    uint8_t Offset;
+    /* If protected and not authenticated, ensure the wraparound is at the first protected page */
+    if (ReadAccessProtected && !Authenticated) {
+        PageLimit = MIN(FirstAuthenticatedPage, Tag.PageCount);
+    }
+    /* Validation */
+    if (PageAddress >= PageLimit) {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+    /* Read out, emulating the wraparound */
+    for (Offset = 0; Offset < BYTES_PER_READ; Offset += TYPE2TAG_PAGE_SIZE) {
+        AppCardMemoryRead(&Buffer[Offset], PageAddress * TYPE2TAG_PAGE_SIZE, TYPE2TAG_PAGE_SIZE);
+        PageAddress++;
+        if (PageAddress == PageLimit) {
+            PageAddress = 0;
+        }
+    }
+    return (BYTES_PER_READ * 8) | ISO14443A_APP_APPEND_CRCA;
+}
+
+static uint16_t AppCmdWrite(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    /* This is a write command containing 4 bytes of data that
+    * should be written to the given page address. */
+    uint8_t PageAddress = Buffer[1];
+    /* Validation */
+    if ((PageAddress < PAGE_WRITE_MIN) || (PageAddress >= Tag.PageCount)) {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+    if (!VerifyAuthentication(PageAddress)) {
+        Buffer[0] = Tag.NakAuth;
+        return NAK_FRAME_SIZE;
+    }
+    AppWritePage(PageAddress, &Buffer[2]);
+    Buffer[0] = ACK_VALUE;
+    return ACK_FRAME_SIZE;
+}
+
+static uint16_t AppCmdCompatWrite(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    uint8_t PageAddress = Buffer[1];
+    /* Validation */
+    if ((PageAddress < PAGE_WRITE_MIN) || (PageAddress >= Tag.PageCount)) {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+    if (!VerifyAuthentication(PageAddress)) {
+        Buffer[0] = Tag.NakAuth;
+        return NAK_FRAME_SIZE;
+    }
+    /* CRC check passed and page-address is within bounds.
+    * Store address and proceed to receiving the data. */
+    CompatWritePageAddress = PageAddress;
+    ArmedForCompatWrite = true;
+    Buffer[0] = ACK_VALUE;
+    return ACK_FRAME_SIZE;
+}
+
+static uint16_t AppCmdHalt(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    /* Halts the tag. According to the ISO14443, the second
+    * byte is supposed to be 0. */
+    if (Buffer[1] == 0) {
+        /* According to ISO14443, we must not send anything
+        * in order to acknowledge the HALT command. */
+        State = STATE_HALT;
+        return ISO14443A_APP_NO_RESPONSE;
+    } else {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+}
+
+static uint16_t AppCmdGetVersion(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    /* Check new dump format and get version from out of pages area (skip 3 pages of counters) */
+    if (!AppCardMemoryRead(Buffer, ExtraAreaAddress(VERSION_OFFSET_PAGES), TYPE2TAG_VERSION_INFO_LENGTH)
+        || Buffer[6] != Tag.Version[6]) {
+        /* Provide hardcoded version response */
+        memcpy(Buffer, Tag.Version, TYPE2TAG_VERSION_INFO_LENGTH);
+    }
+    return (TYPE2TAG_VERSION_INFO_LENGTH * 8) | ISO14443A_APP_APPEND_CRCA;
+}
+
+static uint16_t AppCmdFastRead(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    uint8_t StartPageAddress = Buffer[1];
+    uint8_t EndPageAddress = Buffer[2];
+    /* Validation */
+    if ((StartPageAddress > EndPageAddress) || (EndPageAddress >= Tag.PageCount)) {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+    ByteCount = (EndPageAddress - StartPageAddress + 1) * TYPE2TAG_PAGE_SIZE;
+    if (ByteCount > BYTES_PER_FAST_READ_MAX) {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+    /* Check authentication only if protection is read&write */
+    if (ReadAccessProtected) {
+        if (!VerifyAuthentication(StartPageAddress) || !VerifyAuthentication(EndPageAddress)) {
+            Buffer[0] = Tag.NakAuth;
+            return NAK_FRAME_SIZE;
+        }
+    }
+    /* NOTE: With the current implementation, reading the password out is possible. */
+    AppCardMemoryRead(Buffer, StartPageAddress * TYPE2TAG_PAGE_SIZE, ByteCount);
+    return (ByteCount * 8) | ISO14443A_APP_APPEND_CRCA;
+}
+
+static uint16_t AppCmdPwdAuth(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    uint8_t Password[TYPE2TAG_PWD_SIZE];
+
+    /* Remember the password; it reaches working memory in the background */
+    if ((Tag.Commands & TYPE2TAG_PWD_SNIFF) && memcmp(LastPassword, &Buffer[1], TYPE2TAG_PWD_SIZE) != 0) {
+        memcpy(LastPassword, &Buffer[1], TYPE2TAG_PWD_SIZE);
+        PasswordDirty = true;
+    }
+
+    /* TODO: Verify value and increment authentication attempt counter (AUTHLIM) */
+
+    /* Read and compare the password. Ack like a magic backdoor if UidMode is set, on the flavors offering it */
+    AppCardMemoryRead(Password, ConfigAreaAddress() + CONF_PASSWORD_OFFSET, TYPE2TAG_PWD_SIZE);
+    if ( !((Tag.Commands & TYPE2TAG_PWD_UID_BACKDOOR) && AppMemoryUidMode())
+            && (memcmp(Password, &Buffer[1], TYPE2TAG_PWD_SIZE) != 0) ) {
+        Buffer[0] = Tag.NakAuth;
+        return NAK_FRAME_SIZE;
+    }
+    /* Authenticate the user */
+    Authenticated = true;
+    /* Send the PACK value back */
+    AppCardMemoryRead(Buffer, ConfigAreaAddress() + CONF_PACK_OFFSET, PACK_SIZE);
+    return (PACK_SIZE * 8) | ISO14443A_APP_APPEND_CRCA;
+}
+
+static uint16_t AppCmdReadCnt(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    uint8_t CounterId = Buffer[1];
+    /* Validation */
+    if (CounterId > CNT_MAX) {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+    /* Returned counter length is 3 bytes */
+    memcpy(Buffer, Counters.Counter[CounterId], CNT_SIZE);
+    return (CNT_SIZE * 8) | ISO14443A_APP_APPEND_CRCA;
+}
+
+static uint16_t AppCmdIncrementCnt(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    uint8_t CounterId = Buffer[1];
+    uint32_t Addend = ((uint32_t)Buffer[2]) | ((uint32_t)Buffer[3] << 8) | ((uint32_t)Buffer[4] << 16);
+    /* Validation */
+    if (CounterId > CNT_MAX) {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+    if (!CounterAdd(CounterId, Addend)) {
+        Buffer[0] = NAK_CTR_ERROR;
+        return NAK_FRAME_SIZE;
+    }
+    Buffer[0] = ACK_VALUE;
+    if ((Addend != 0) && CountersPersistent) {
+        if (CountersDirty) {
+            /* The previous increment is not on flash yet. Write both, the ACK
+             * goes out on time meanwhile. */
+            ISO14443ACodecSetProvisional(Buffer, NULL, ACK_FRAME_SIZE);
+            CountersPersist();
+        } else {
+            CountersDirty = true;
+        }
+    }
+    return ACK_FRAME_SIZE;
+}
+
+static uint16_t AppCmdReadSig(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    /* Check new dump format and get signature from out of pages area (skip 3 pages of counters, 2 pages VERSION) */
+    bool Valid = AppCardMemoryRead(Buffer, ExtraAreaAddress(SIGNATURE_OFFSET_PAGES), SIGNATURE_LENGTH);
+    if (Valid) {
+        Valid = false;
+        for (uint8_t i = 0; i < SIGNATURE_LENGTH; i++) {
+            Valid |= (Buffer[i] != 0);
+        }
+    }
+    if (!Valid) {
+        /* Hardcoded response */
+        memset(Buffer, SIGNATURE_DEFAULT_BYTE, SIGNATURE_LENGTH);
+    }
+    return (SIGNATURE_LENGTH * 8) | ISO14443A_APP_APPEND_CRCA;
+}
+
+static uint16_t AppCmdCheckTearingEvent(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    uint8_t CounterId = Buffer[1];
+    /* Validation */
+    if (CounterId > CNT_MAX) {
+        Buffer[0] = NAK_INVALID_ARG;
+        return NAK_FRAME_SIZE;
+    }
+    Buffer[0] = Counters.Tearing[CounterId];
+    return (TEARING_SIZE * 8) | ISO14443A_APP_APPEND_CRCA;
+}
+
+static uint16_t AppCmdVcsl(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    /* Input is ignored completely */
+    /* Read out the value */
+    AppCardMemoryRead(Buffer, ConfigAreaAddress() + CONF_VCTID_OFFSET, 1);
+    return (1 * 8) | ISO14443A_APP_APPEND_CRCA;
+}
+
+typedef uint16_t (*Type2TagCommandFuncType)(uint8_t* const Buffer, uint16_t ByteCount);
+
+typedef struct {
+    uint8_t Command; /// Command byte, tells it from other bytes in the same CommandIndexTable slot
+    Type2TagCommandFuncType CommandFunc;
+    uint16_t Requires; /// TYPE2TAG_CMD_* flag the flavor must set, 0 if mandatory
+} Type2TagCommandType;
+
+enum {
+    CMD_IDX_NONE = 0,
+    CMD_IDX_READ,
+    CMD_IDX_WRITE,
+    CMD_IDX_COMPAT_WRITE,
+    CMD_IDX_HALT,
+    CMD_IDX_GET_VERSION,
+    CMD_IDX_FAST_READ,
+    CMD_IDX_PWD_AUTH,
+    CMD_IDX_READ_CNT,
+    CMD_IDX_INCREMENT_CNT,
+    CMD_IDX_READ_SIG,
+    CMD_IDX_CHECK_TEARING_EVENT,
+    CMD_IDX_VCSL
+};
+
+static const Type2TagCommandType CommandTable[] PROGMEM = {
+    [CMD_IDX_NONE]                  = { .Command = 0,                       .CommandFunc = NULL,                    .Requires = 0 },
+    [CMD_IDX_READ]                  = { .Command = CMD_READ,                .CommandFunc = AppCmdRead,              .Requires = 0 },
+    [CMD_IDX_WRITE]                 = { .Command = CMD_WRITE,               .CommandFunc = AppCmdWrite,             .Requires = 0 },
+    [CMD_IDX_COMPAT_WRITE]          = { .Command = CMD_COMPAT_WRITE,        .CommandFunc = AppCmdCompatWrite,       .Requires = 0 },
+    [CMD_IDX_HALT]                  = { .Command = CMD_HALT,                .CommandFunc = AppCmdHalt,              .Requires = 0 },
+    [CMD_IDX_GET_VERSION]           = { .Command = CMD_GET_VERSION,         .CommandFunc = AppCmdGetVersion,        .Requires = TYPE2TAG_CMD_GET_VERSION },
+    [CMD_IDX_FAST_READ]             = { .Command = CMD_FAST_READ,           .CommandFunc = AppCmdFastRead,          .Requires = TYPE2TAG_CMD_FAST_READ },
+    [CMD_IDX_PWD_AUTH]              = { .Command = CMD_PWD_AUTH,            .CommandFunc = AppCmdPwdAuth,           .Requires = TYPE2TAG_CMD_PWD_AUTH },
+    [CMD_IDX_READ_CNT]              = { .Command = CMD_READ_CNT,            .CommandFunc = AppCmdReadCnt,           .Requires = TYPE2TAG_CMD_READ_CNT },
+    [CMD_IDX_INCREMENT_CNT]         = { .Command = CMD_INCREMENT_CNT,       .CommandFunc = AppCmdIncrementCnt,      .Requires = TYPE2TAG_CMD_INCREMENT_CNT },
+    [CMD_IDX_READ_SIG]              = { .Command = CMD_READ_SIG,            .CommandFunc = AppCmdReadSig,           .Requires = TYPE2TAG_CMD_READ_SIG },
+    [CMD_IDX_CHECK_TEARING_EVENT]   = { .Command = CMD_CHECK_TEARING_EVENT, .CommandFunc = AppCmdCheckTearingEvent, .Requires = TYPE2TAG_CMD_CHECK_TEARING },
+    [CMD_IDX_VCSL]                  = { .Command = CMD_VCSL,                .CommandFunc = AppCmdVcsl,              .Requires = TYPE2TAG_CMD_VCSL },
+};
+
+/* Maps a command byte to its CommandTable index in constant time. The hash spreads the
+ * command bytes below over the slots without collisions. A colliding command added
+ * later would silently replace another entry, so that is made a build error. */
+#define CMD_HASH_SIZE           32
+#define CMD_HASH(Cmd)           (((Cmd) ^ ((Cmd) >> 2)) & (CMD_HASH_SIZE - 1))
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic error "-Woverride-init"
+static const uint8_t CommandIndexTable[CMD_HASH_SIZE] PROGMEM = {
+    [CMD_HASH(CMD_READ)]                  = CMD_IDX_READ,
+    [CMD_HASH(CMD_WRITE)]                 = CMD_IDX_WRITE,
+    [CMD_HASH(CMD_COMPAT_WRITE)]          = CMD_IDX_COMPAT_WRITE,
+    [CMD_HASH(CMD_HALT)]                  = CMD_IDX_HALT,
+    [CMD_HASH(CMD_GET_VERSION)]           = CMD_IDX_GET_VERSION,
+    [CMD_HASH(CMD_FAST_READ)]             = CMD_IDX_FAST_READ,
+    [CMD_HASH(CMD_PWD_AUTH)]              = CMD_IDX_PWD_AUTH,
+    [CMD_HASH(CMD_READ_CNT)]              = CMD_IDX_READ_CNT,
+    [CMD_HASH(CMD_INCREMENT_CNT)]         = CMD_IDX_INCREMENT_CNT,
+    [CMD_HASH(CMD_READ_SIG)]              = CMD_IDX_READ_SIG,
+    [CMD_HASH(CMD_CHECK_TEARING_EVENT)]   = CMD_IDX_CHECK_TEARING_EVENT,
+    [CMD_HASH(CMD_VCSL)]                  = CMD_IDX_VCSL,
+};
+#pragma GCC diagnostic pop
+
+/* Handles processing of Type 2 commands */
+static uint16_t AppProcess(uint8_t* const Buffer, uint16_t ByteCount)
+{
+    uint8_t Index = pgm_read_byte(&CommandIndexTable[CMD_HASH(Buffer[0])]);
+    uint16_t Requires = pgm_read_word(&CommandTable[Index].Requires);
+
+    /* Handle the compatibility write command */
+    if (ArmedForCompatWrite) {
+        ArmedForCompatWrite = false;
+        AppWritePage(CompatWritePageAddress, &Buffer[0]);
+        Buffer[0] = ACK_VALUE;
+        return ACK_FRAME_SIZE;
+    }
+
+    if ( (Index != CMD_IDX_NONE) && (pgm_read_byte(&CommandTable[Index].Command) == Buffer[0])
+            && ((Tag.Commands & Requires) == Requires) ) {
+        Type2TagCommandFuncType CommandFunc = pgm_read_ptr(&CommandTable[Index].CommandFunc);
+        return CommandFunc(Buffer, ByteCount);
+    }
+
+    /* Command not handled. Switch to idle. */
+    State = STATE_IDLE;
+    return ISO14443A_APP_NO_RESPONSE;
+}
+
+uint16_t Type2TagAppProcess(uint8_t* Buffer, uint16_t BitCount)
+{
+    uint8_t Cmd = Buffer[0];
+    uint16_t ByteCount = (BitCount + 7) >> 3;
+
+    FrameSeen = true;
+
+    switch(State) {
+    case STATE_IDLE:
+    case STATE_HALT:
+        FromHalt = State == STATE_HALT;
+        if (ISO14443AWakeUp(Buffer, &BitCount, CardATQAValue, FromHalt)) {
+            /* We received a REQA or WUPA command, so wake up. */
+            State = STATE_READY1;
+            return BitCount;
+        }
+        break;
+
+    case STATE_READY1:
+    case STATE_READY2:
+        if (ISO14443AWakeUp(Buffer, &BitCount, CardATQAValue, FromHalt)) {
+            State = FromHalt ? STATE_HALT : STATE_IDLE;
+            return ISO14443A_APP_NO_RESPONSE;
+        } else if (Cmd == ISO14443A_CMD_SELECT_CL1 && State == STATE_READY1) {
+            /* Load UID CL1 and perform anticollision. Since
+            * Type 2 tags use a double-sized UID, the first byte
+            * of CL1 has to be the cascade-tag byte. */
+            uint8_t UidCL1[ISO14443A_CL_UID_SIZE] = { [0] = ISO14443A_UID0_CT };
+
+            AppCardMemoryRead(&UidCL1[1], UID_CL1_ADDRESS, UID_CL1_SIZE);
+
+            if (ISO14443ASelect(Buffer, &BitCount, UidCL1, CardSAKValue)) {
+                /* CL1 stage has ended successfully */
+                State = STATE_READY2;
+            }
+
+            return BitCount;
+        } else if (Cmd == ISO14443A_CMD_SELECT_CL2 && State == STATE_READY2) {
+            /* Load UID CL2 and perform anticollision */
+            uint8_t UidCL2[ISO14443A_CL_UID_SIZE];
+
+            AppCardMemoryRead(UidCL2, UID_CL2_ADDRESS, UID_CL2_SIZE);
+
+            if (ISO14443ASelect(Buffer, &BitCount, UidCL2, SAK_CL2_VALUE)) {
+                /* CL2 stage has ended successfully. This means
+                * our complete UID has been sent to the reader. */
+                State = STATE_ACTIVE;
+            }
+
+            return BitCount;
+        } else if (Cmd == CMD_READ && ByteCount == (CMD_READ_FRAME_SIZE + ISO14443A_CRCA_SIZE) && Buffer[1] == 0) {
+            /* This is a short activation method */
+            State = STATE_ACTIVE;
+            return AppProcess(Buffer, CMD_READ_FRAME_SIZE);
+        } else {
+            /* Unknown command. Enter halt state */
+            State = STATE_IDLE;
+        }
+        break;
+
+    case STATE_ACTIVE:
+        if (ISO14443AWakeUp(Buffer, &BitCount, CardATQAValue, FromHalt)) {
+            State = FromHalt ? STATE_HALT : STATE_IDLE;
+            return ISO14443A_APP_NO_RESPONSE;
+        }
+        /* At the very least, there should be 3 bytes in the buffer. */
+        if (ByteCount < (1 + ISO14443A_CRCA_SIZE)) {
+            State = STATE_IDLE;
+            return ISO14443A_APP_NO_RESPONSE;
+        }
+        /* All commands here have CRCA appended; verify it right away */
+        ByteCount -= ISO14443A_CRCA_SIZE;
+        if (!ISO14443ACheckFrameCRCA(Buffer, ByteCount)) {
+            Buffer[0] = NAK_CRC_ERROR;
+            return NAK_FRAME_SIZE;
+        }
+        return AppProcess(Buffer, ByteCount);
+
+    default:
+        /* Unknown state? Should never happen. */
+        break;
+    }
+
+    /* No response has been sent, when we reach here */
+    return ISO14443A_APP_NO_RESPONSE;
+}
+
+void Type2TagGetUid(ConfigurationUidType Uid)
+{
+    /* Read UID from memory */
+    AppCardMemoryRead(&Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE);
+    AppCardMemoryRead(&Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE);
+}
+
+void Type2TagSetUid(ConfigurationUidType Uid)
+{
+    /* Calculate check bytes and write everything into memory */
+    uint8_t BCC1 = ISO14443A_UID0_CT ^ Uid[0] ^ Uid[1] ^ Uid[2];
+    uint8_t BCC2 = Uid[3] ^ Uid[4] ^ Uid[5] ^ Uid[6];
+
+    AppCardMemoryWrite(&Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE);
+    AppCardMemoryWrite(&BCC1, UID_BCC1_ADDRESS, ISO14443A_CL_BCC_SIZE);
+    AppCardMemoryWrite(&Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE);
+    AppCardMemoryWrite(&BCC2, UID_BCC2_ADDRESS, ISO14443A_CL_BCC_SIZE);
+}
+
+void Type2TagGetAtqa(uint16_t * Atqa)
+{
+    *Atqa = CardATQAValue;
+}
+
+void Type2TagSetAtqa(uint16_t Atqa)
+{
+    CardATQAValue = Atqa;
+}
+
+void Type2TagGetSak(uint8_t * Sak)
+{
+    *Sak = CardSAKValue;
+}
+
+void Type2TagSetSak(uint8_t Sak)
+{
+    CardSAKValue = Sak;
+}
+
+#endif /* Compilation support */
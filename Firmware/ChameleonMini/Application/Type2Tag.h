@@ -0,0 +1,73 @@
+/*
+ * Type2Tag.h
+ *
+ *  Common engine for NFC Forum Type 2 tags (MIFARE Ultralight family and NTAG21x).
+ *  Card flavors only differ by a PROGMEM descriptor handed over at init.
+ */
+
+#if ((defined CONFIG_MF_ULTRALIGHT_SUPPORT) || (defined CONFIG_NTAG213_SUPPORT) || (defined CONFIG_NTAG215_SUPPORT) || (defined CONFIG_NTAG216_SUPPORT))
+
+#ifndef TYPE2TAG_H_
+#define TYPE2TAG_H_
+
+#include "Application.h"
+#include "ISO14443-3A.h"
+
+#define TYPE2TAG_UID_SIZE               ISO14443A_UID_SIZE_DOUBLE
+#define TYPE2TAG_PAGE_SIZE              4 /* Bytes */
+#define TYPE2TAG_VERSION_INFO_LENGTH    8
+#define TYPE2TAG_NO_CONFIG_AREA         0
+#define TYPE2TAG_PWD_ADDRESS            0 // In working memory
+#define TYPE2TAG_PWD_SIZE               4 // Bytes
+
+/* Counter journal in working memory, see Type2Tag.c. Each bank is larger than the
+ * biggest SPI flash page, so two consecutive records never share a flash page. */
+#define TYPE2TAG_CNT_JOURNAL_ADDRESS    16 // In working memory
+#define TYPE2TAG_CNT_RECORD_SIZE        16 // Bytes
+#define TYPE2TAG_CNT_BANK_RECORDS       36
+#define TYPE2TAG_CNT_BANK_SIZE          (TYPE2TAG_CNT_BANK_RECORDS * TYPE2TAG_CNT_RECORD_SIZE)
+#define TYPE2TAG_CNT_JOURNAL_SIZE       (2 * TYPE2TAG_CNT_BANK_SIZE)
+#define TYPE2TAG_WORKING_MEM_SIZE       (TYPE2TAG_CNT_JOURNAL_ADDRESS + TYPE2TAG_CNT_JOURNAL_SIZE)
+
+/* Optional commands a flavor may support. READ, WRITE, COMPAT_WRITE and HALT are always supported. */
+#define TYPE2TAG_CMD_GET_VERSION        (1 << 0)
+#define TYPE2TAG_CMD_FAST_READ          (1 << 1)
+#define TYPE2TAG_CMD_PWD_AUTH           (1 << 2)
+#define TYPE2TAG_CMD_READ_CNT           (1 << 3)
+#define TYPE2TAG_CMD_INCREMENT_CNT      (1 << 4)
+#define TYPE2TAG_CMD_READ_SIG           (1 << 5)
+#define TYPE2TAG_CMD_CHECK_TEARING      (1 << 6)
+#define TYPE2TAG_CMD_VCSL               (1 << 7)
+/* PWD_AUTH keeps the last password received in working memory */
+#define TYPE2TAG_PWD_SNIFF              (1 << 8)
+/* PWD_AUTH accepts any password while UidMode is set */
+#define TYPE2TAG_PWD_UID_BACKDOOR       (1 << 9)
+
+/* Describes one Type 2 tag flavor. Instances live in PROGMEM. */
+typedef struct {
+    uint8_t PageCount; /// Number of user visible pages
+    uint8_t ConfigAreaPage; /// Page holding AUTH0 (CFG0), or TYPE2TAG_NO_CONFIG_AREA
+    uint16_t Commands; /// Mask of supported TYPE2TAG_CMD_* commands
+    uint8_t NakAuth; /// NAK value returned on authentication failures
+    uint8_t Version[TYPE2TAG_VERSION_INFO_LENGTH]; /// Default GET_VERSION response
+} Type2TagDescriptorType;
+
+void Type2TagAppInit(const Type2TagDescriptorType* Descriptor);
+void Type2TagAppReset(void);
+void Type2TagAppTick(void);
+void Type2TagAppTask(void);
+void Type2TagAppFlush(void);
+
+uint16_t Type2TagAppProcess(uint8_t* Buffer, uint16_t BitCount);
+
+void Type2TagGetUid(ConfigurationUidType Uid);
+void Type2TagSetUid(ConfigurationUidType Uid);
+
+void Type2TagGetAtqa(uint16_t * Atqa);
+void Type2TagSetAtqa(uint16_t Atqa);
+void Type2TagGetSak(uint8_t * Sak);
+void Type2TagSetSak(uint8_t Sak);
+
+#endif /* TYPE2TAG_H_ */
+
+#endif /* Compilation support */
@@ -24,6 +24,6 @@ int main(void) {
         }
         TerminalTask();
         CodecTask();
-        //ApplicationTask();
+        ApplicationTask();
     }
 }
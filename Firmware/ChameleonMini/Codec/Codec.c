@@ -1,3 +1,45 @@
+#include <avr/interrupt.h>
 #include "Codec.h"
 
 uint8_t CodecBuffer[CODEC_BUFFER_SIZE];
+
+#ifdef SUPPORT_PROCESS_INTERRUPT
+volatile uint8_t CodecProcessLocked = 0;
+static volatile bool CodecProcessDeferred = false;
+static uint8_t CodecProcessDummy;
+
+/* A one byte transfer per request, only for its completion interrupt */
+void CodecProcessInit(void) {
+    DMA.CTRL |= DMA_ENABLE_bm;
+    CODEC_PROCESS_DMA.CTRLA = 0;
+    CODEC_PROCESS_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_BLOCK_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_BLOCK_gc | DMA_CH_DESTDIR_FIXED_gc;
+    CODEC_PROCESS_DMA.TRIGSRC = DMA_CH_TRIGSRC_OFF_gc;
+    CODEC_PROCESS_DMA.TRFCNT = 1;
+    CODEC_PROCESS_DMA.REPCNT = 0; /* Unlimited, the channel stays enabled */
+    CODEC_PROCESS_DMA.SRCADDR0 = ((uint16_t) &CodecProcessDummy >> 0) & 0xFF;
+    CODEC_PROCESS_DMA.SRCADDR1 = ((uint16_t) &CodecProcessDummy >> 8) & 0xFF;
+    CODEC_PROCESS_DMA.SRCADDR2 = 0;
+    CODEC_PROCESS_DMA.DESTADDR0 = ((uint16_t) &CodecProcessDummy >> 0) & 0xFF;
+    CODEC_PROCESS_DMA.DESTADDR1 = ((uint16_t) &CodecProcessDummy >> 8) & 0xFF;
+    CODEC_PROCESS_DMA.DESTADDR2 = 0;
+    CODEC_PROCESS_DMA.CTRLB = DMA_CH_TRNIF_bm | DMA_CH_TRNINTLVL_MED_gc;
+    CODEC_PROCESS_DMA.CTRLA = CODEC_PROCESS_DMA_CTRLA;
+}
+
+void CodecProcessUnlock(void) {
+    if ((--CodecProcessLocked == 0) && CodecProcessDeferred) {
+        CodecProcessDeferred = false;
+        CodecProcessTrigger();
+    }
+}
+
+ISR(CODEC_PROCESS_VECT) {
+    CODEC_PROCESS_DMA.CTRLB = DMA_CH_TRNIF_bm | DMA_CH_TRNINTLVL_MED_gc;
+
+    if (CodecProcessLocked) {
+        CodecProcessDeferred = true;
+    } else {
+        ActiveConfiguration.CodecTaskFunc();
+    }
+}
+#endif
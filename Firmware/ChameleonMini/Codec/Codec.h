@@ -37,21 +37,66 @@
 #define CODEC_SUBCARRIER_CCEN_OOK	TC0_CCBEN_bm
 #define CODEC_TIMER_SAMPLING		TCC1
 #define CODEC_TIMER_SAMPLING_CCA_VECT	TCC1_CCA_vect
+#define CODEC_TIMER_SAMPLING_OVF_VECT	TCC1_OVF_vect
+#define CODEC_DEMOD_DMA             DMA.CH0 /* Edge capture, see SUPPORT_EDGE_DEMOD */
+#define CODEC_LOADMOD_DMA0          DMA.CH2 /* Double buffered pair, see SUPPORT_DMA_LOADMOD */
+#define CODEC_LOADMOD_DMA1          DMA.CH3
+#define CODEC_LOADMOD_DMA0_VECT     DMA_CH2_vect
+#define CODEC_LOADMOD_DMA1_VECT     DMA_CH3_vect
+#define CODEC_LOADMOD_DMA_DBUFMODE  DMA_DBUFMODE_CH23_gc
+#define CODEC_LOADMOD_DMA_TRIGSRC   DMA_CH_TRIGSRC_TCD1_OVF_gc
+#define CODEC_PROCESS_DMA           DMA.CH1 /* Software interrupt, see SUPPORT_PROCESS_INTERRUPT */
+#define CODEC_PROCESS_VECT          DMA_CH1_vect
+#define CODEC_PROCESS_DMA_CTRLA     (DMA_CH_ENABLE_bm | DMA_CH_REPEAT_bm | DMA_CH_BURSTLEN_1BYTE_gc)
 #define CODEC_TIMER_LOADMOD       	TCD1
 #define CODEC_TIMER_OVF_VECT		TCD1_OVF_vect
 
-#define CODEC_BUFFER_SIZE           256 /* Byte */
+#define CODEC_BUFFER_DATA_SIZE      128 /* Byte, followed by the parity bits, 8 per byte */
+#ifdef SUPPORT_EDGE_DEMOD
+#define CODEC_BUFFER_SIZE           256 /* Byte, room for the pause captures of a frame */
+#else
+#define CODEC_BUFFER_SIZE           (CODEC_BUFFER_DATA_SIZE + CODEC_BUFFER_DATA_SIZE / 8)
+#endif
 
 #define CODEC_CARRIER_FREQ          13560000
 
 extern uint8_t CodecBuffer[CODEC_BUFFER_SIZE];
 
+#ifdef SUPPORT_PROCESS_INTERRUPT
+/* The codec task runs from a medium level interrupt, requested by the codec when
+ * a frame has been received or sent. Main loop code holds it off with the lock
+ * only while touching state the application uses too: the SPI flash and
+ * application buffers filled or drained by the interrupt. Locks nest, a request
+ * coming in meanwhile runs on the last unlock. */
+extern volatile uint8_t CodecProcessLocked;
+
+void CodecProcessInit(void);
+void CodecProcessUnlock(void);
+
+INLINE void CodecProcessLock(void) {
+    CodecProcessLocked++;
+}
+
+INLINE void CodecProcessTrigger(void) {
+    CODEC_PROCESS_DMA.CTRLA = CODEC_PROCESS_DMA_CTRLA | DMA_CH_TRFREQ_bm;
+}
+#else
+INLINE void CodecProcessLock(void) { }
+INLINE void CodecProcessUnlock(void) { }
+INLINE void CodecProcessTrigger(void) { }
+#endif
+
 INLINE void CodecInit(void) {
+#ifdef SUPPORT_PROCESS_INTERRUPT
+    CodecProcessInit();
+#endif
     ActiveConfiguration.CodecInitFunc();
 }
 
 INLINE void CodecTask(void) {
+#ifndef SUPPORT_PROCESS_INTERRUPT
     ActiveConfiguration.CodecTaskFunc();
+#endif
 }
 
 INLINE void CodecSetDemodPower(bool bOnOff) {
@@ -53,10 +53,19 @@
  * policies, either expressed or implied, of the ORIGINAL AUTHORS.
  */
 
+#include <string.h>
 #include "ISO14443-2A.h"
 #include "../System.h"
 #include "../Application/Application.h"
+#include "../Application/ISO14443-3A.h"
 #include "Codec.h"
+#include "../Perf.h"
+#ifdef SUPPORT_LIVE_TRACE
+#include "../Trace.h"
+#endif
+#ifdef SUPPORT_LATENCY_STATS
+#include "../Latency.h"
+#endif
 
 /* Timing definitions for ISO14443A */
 #define ISO14443A_SUBCARRIER_DIVIDER    16
@@ -69,6 +78,31 @@
  * For that we need to convert the bit rate for the internal clock. */
 #define SAMPLE_RATE_SYSTEM_CYCLES       ((uint16_t) (((uint64_t) F_CPU * ISO14443A_BIT_RATE_CYCLES) / CODEC_CARRIER_FREQ) )
 
+#ifdef SUPPORT_EDGE_DEMOD
+/* The start of every modulation pause is captured from the timestamp timer by the
+ * DMA, low byte only, into the codec buffer. The sampling timer is restarted by the
+ * same event and signals EOC when it overflows, 2.5 bits after the last pause, as
+ * pauses are never more than 2 bits apart within a frame. */
+#define EDGE_EOC_SYSTEM_CYCLES          (SAMPLE_RATE_SYSTEM_CYCLES * 5 / 2)
+/* Timestamp ticks to half bits: (Ticks * EDGE_HALF_BITS_PER_TICK_Q + round) >> EDGE_HALF_BITS_SHIFT */
+#define EDGE_HALF_BITS_SHIFT            12
+#define EDGE_HALF_BITS_PER_TICK(Shift)  ((uint16_t) ((((uint64_t) CODEC_CARRIER_FREQ * 2 << (Shift)) \
+                                                      + (uint64_t) SYSTEM_TIMESTAMP_FREQ * ISO14443A_BIT_RATE_CYCLES / 2) \
+                                                     / ((uint64_t) SYSTEM_TIMESTAMP_FREQ * ISO14443A_BIT_RATE_CYCLES)))
+#define EDGE_HALF_BITS_PER_TICK_Q       EDGE_HALF_BITS_PER_TICK(EDGE_HALF_BITS_SHIFT)
+#define EDGE_HALF_BITS_PER_TICK_Q16     EDGE_HALF_BITS_PER_TICK(16)
+#define EDGE_BUFFER_SIZE                (CODEC_BUFFER_SIZE - 1) /* Captures, so that the count fits a byte */
+#endif
+
+#ifdef SUPPORT_DMA_LOADMOD
+/* The answer is encoded a byte at a time into chunks of half bits, each one the value
+ * the DMA writes to the OUTTGL register of the load modulation port on the next loadmod
+ * timer overflow. Two chunks alternate in a double buffered DMA channel pair. A chunk
+ * holds the end of the start bit, 8 data bits, parity, the stop bit and a last half bit
+ * to finish on, at most. */
+#define LOADMOD_CHUNK_SIZE              (1 + 2 * 8 + 2 + 2 + 1)
+#endif
+
 static volatile struct {
     volatile bool DemodFinished;
     volatile bool LoadmodFinished;
@@ -90,6 +124,7 @@ typedef enum {
 
 static volatile uint8_t* CodecBufferPtr;
 static volatile uint8_t* ParityBufferPtr;
+static volatile uint8_t ParityMask; /* Of the current bit at ParityBufferPtr */
 static volatile uint16_t BitCount;
 static volatile uint16_t BitSent;
 static volatile uint8_t DataRegister;
@@ -98,6 +133,207 @@ static volatile bool IsParityBit;
 static volatile uint8_t LastBit;
 static volatile LoadModStateType LoadModState;
 static volatile bool SamplePosition;
+static volatile bool FrameDelayElapsed;
+static volatile bool FrameOverflow; /* Reader frame did not fit, it gets dropped */
+#ifdef SUPPORT_EDGE_DEMOD
+static volatile uint16_t EdgeStart; /* Capture of the SOF pause, all 16 bits */
+static volatile uint8_t EdgeCount;
+#endif
+#ifdef SUPPORT_STREAMING_CRC
+static volatile uint16_t Checksum; /* Of the reader frame while demodulating, of the answer while sending */
+static volatile uint8_t* CRCBufferPtr; /* Where the CRC of the answer goes, NULL for none */
+static volatile bool CustomParity;
+#endif
+
+/* Fallback answer, sent by the loadmod ISR when the FDT is reached while the
+ * application is still busy. See ISO14443ACodecSetProvisional */
+static uint8_t ProvisionalBuffer[ISO14443A_PROVISIONAL_MAX_BYTES + 1]; /* Data, then parity bits */
+static volatile uint8_t ProvisionalBitCount;
+static volatile bool ProvisionalSent;
+
+#ifdef SUPPORT_DMA_LOADMOD
+/* Manchester levels of a nibble, LSB first: a 1 is modulated during the first half bit,
+ * a 0 during the second one */
+static const uint8_t ManchesterNibble[16] PROGMEM = {
+    0xAA, 0xA9, 0xA6, 0xA5, 0x9A, 0x99, 0x96, 0x95,
+    0x6A, 0x69, 0x66, 0x65, 0x5A, 0x59, 0x56, 0x55
+};
+
+static uint8_t LoadmodChunk[2][LOADMOD_CHUNK_SIZE];
+static uint8_t LoadmodChunkLength[2];
+static uint8_t LoadmodLevel; /* Of the last half bit encoded */
+static volatile uint8_t LoadmodChunksQueued;
+#endif
+
+volatile ISO14443AFrameTimesType ISO14443AFrameTimes;
+#ifdef SUPPORT_STREAMING_CRC
+ISO14443AFrameCRCAType ISO14443AFrameCRCA;
+#endif
+
+/* All bits are out */
+INLINE void LoadmodFinish(void) {
+    /* Deactivate the loadmod timer, its interrupt and the subcarrier divider. */
+    CODEC_TIMER_LOADMOD.CTRLA = TC_CLKSEL_OFF_gc;
+    CODEC_TIMER_LOADMOD.INTCTRLA = 0;
+    CODEC_SUBCARRIER_TIMER.CTRLA = TC_CLKSEL_OFF_gc;
+    ISO14443AFrameTimes.TagEnd = SystemGetTimestamp();
+
+    /* Signal application that we have finished loadmod */
+    Flags.LoadmodFinished = 1;
+    CodecProcessTrigger();
+}
+
+/* Parity bits, packed as described with ISO14443A_BUFFER_PARITY_OFFSET. Storing the
+ * first bit of a byte clears the others. */
+INLINE void ParityStore(uint8_t Bit) {
+    uint8_t Mask = ParityMask;
+    uint8_t Parity = (Mask == 0x01) ? 0x00 : *ParityBufferPtr;
+
+    *ParityBufferPtr = Bit ? (Parity | Mask) : Parity;
+}
+
+INLINE uint8_t ParityLoad(void) {
+    return *ParityBufferPtr & ParityMask;
+}
+
+INLINE void ParityNext(void) {
+    uint8_t Mask = ParityMask << 1;
+
+    if (Mask == 0) {
+        Mask = 0x01;
+        ParityBufferPtr++;
+    }
+    ParityMask = Mask;
+}
+
+#ifdef SUPPORT_STREAMING_CRC
+/* Parity and CRC of the answer byte at CodecBufferPtr, right before it is sent. The
+ * CRC gets stored behind the data when its last byte comes up. */
+INLINE void LoadmodStreamByte(uint8_t Data) {
+    if (!CustomParity) {
+        ParityStore(ODD_PARITY(Data));
+    }
+
+    if (CRCBufferPtr != NULL) {
+        uint16_t NewChecksum = ISO14443AUpdateCRCA(Checksum, Data);
+        Checksum = NewChecksum;
+
+        if (CodecBufferPtr + 1 == CRCBufferPtr) {
+            CRCBufferPtr[0] = (NewChecksum >> 0) & 0xFF;
+            CRCBufferPtr[1] = (NewChecksum >> 8) & 0xFF;
+            CRCBufferPtr = NULL;
+        }
+    }
+}
+#endif
+
+#ifdef SUPPORT_DMA_LOADMOD
+INLINE uint8_t* LoadmodEncode(uint8_t* Ptr, uint16_t Levels, uint8_t HalfBits) {
+    uint16_t Toggles = Levels ^ ((Levels << 1) | LoadmodLevel);
+
+    LoadmodLevel = (Levels >> (HalfBits - 1)) & 0x01;
+    while (HalfBits--) {
+        *Ptr++ = (Toggles & 0x01) ? CODEC_LOADMOD_MASK : 0;
+        Toggles >>= 1;
+    }
+    return Ptr;
+}
+
+/* Encode the next byte of the answer, returns the chunk length */
+static uint8_t LoadmodEncodeChunk(uint8_t* Chunk) {
+    uint8_t* Ptr = Chunk;
+    uint16_t Bits = BitCount - BitSent;
+    uint8_t Data = *CodecBufferPtr;
+
+#ifdef SUPPORT_STREAMING_CRC
+    LoadmodStreamByte(Data);
+#endif
+    CodecBufferPtr++;
+
+    if (BitSent == 0) {
+        /* Second half of the start bit, the first one is set when starting */
+        Ptr = LoadmodEncode(Ptr, 0x00, 1);
+    }
+    if (Bits > 8) {
+        Bits = 8;
+    }
+    Ptr = LoadmodEncode(Ptr, pgm_read_byte(&ManchesterNibble[Data & 0x0F])
+                        | ((uint16_t) pgm_read_byte(&ManchesterNibble[Data >> 4]) << 8), Bits * 2);
+    BitSent += Bits;
+    if (Bits == 8) {
+        Ptr = LoadmodEncode(Ptr, ParityLoad() ? 0x01 : 0x02, 2);
+        ParityNext();
+    }
+    if (BitSent == BitCount) {
+        /* Stop bit, and the half bit after it to finish on */
+        Ptr = LoadmodEncode(Ptr, 0x00, 3);
+    }
+    return Ptr - Chunk;
+}
+
+/* Encode the first two chunks ahead of the frame delay time, from the buffer pointers
+ * and bit count set up for the answer */
+static void LoadmodPrepare(void) {
+    LoadmodLevel = 1;
+    LoadmodChunkLength[0] = LoadmodEncodeChunk(LoadmodChunk[0]);
+    LoadmodChunkLength[1] = (BitSent < BitCount) ? LoadmodEncodeChunk(LoadmodChunk[1]) : 0;
+}
+
+/* In double buffer mode, the DMA enables a channel by itself once the other one is done */
+INLINE void LoadmodQueue(DMA_CH_t* Channel, uint8_t* Chunk, uint8_t Length) {
+    Channel->SRCADDR0 = ((uint16_t) Chunk >> 0) & 0xFF;
+    Channel->SRCADDR1 = ((uint16_t) Chunk >> 8) & 0xFF;
+    Channel->TRFCNT = Length;
+    Channel->TRIGSRC = CODEC_LOADMOD_DMA_TRIGSRC;
+    Channel->CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
+    LoadmodChunksQueued++;
+}
+
+/* Refill a channel the DMA is done with, or finish after the last one. A channel left
+ * without a chunk gets no trigger, so that it idles when enabled */
+INLINE void LoadmodChunkDone(DMA_CH_t* Channel, uint8_t* Chunk) {
+    Channel->CTRLB |= DMA_CH_TRNIF_bm;
+    LoadmodChunksQueued--;
+    if (BitSent < BitCount) {
+        LoadmodQueue(Channel, Chunk, LoadmodEncodeChunk(Chunk));
+    } else if (LoadmodChunksQueued == 0) {
+        CODEC_LOADMOD_DMA0.CTRLA = 0;
+        CODEC_LOADMOD_DMA1.CTRLA = 0;
+        LoadmodFinish();
+    } else {
+        Channel->TRIGSRC = DMA_CH_TRIGSRC_OFF_gc;
+    }
+}
+
+ISR(CODEC_LOADMOD_DMA0_VECT) {
+    LoadmodChunkDone(&CODEC_LOADMOD_DMA0, LoadmodChunk[0]);
+}
+
+ISR(CODEC_LOADMOD_DMA1_VECT) {
+    LoadmodChunkDone(&CODEC_LOADMOD_DMA1, LoadmodChunk[1]);
+}
+#endif
+
+/* Called at EOC */
+INLINE void StartFrameDelay(bool LastBit) {
+    /* By this time, the FDT timer is aligned to the last modulation
+     * edge of the reader. So we disable the auto-synchronization and
+     * let it count the frame delay time in the background, and generate
+     * an interrupt once it has reached the FDT. */
+    CODEC_TIMER_LOADMOD.CTRLD = TC_EVACT_OFF_gc;
+
+    if (LastBit) {
+        CODEC_TIMER_LOADMOD.PER = ISO14443A_FRAME_DELAY_PREV1;
+    } else {
+        CODEC_TIMER_LOADMOD.PER = ISO14443A_FRAME_DELAY_PREV0;
+    }
+
+    LoadModState = LOADMOD_FDT;
+    FrameDelayElapsed = false;
+
+    CODEC_TIMER_LOADMOD.INTFLAGS = TC1_OVFIF_bm;
+    CODEC_TIMER_LOADMOD.INTCTRLA = TC_OVFINTLVL_HI_gc;
+}
 
 static void Initialize(void) {
     /* Configure CARRIER input pin and route it to EVSYS */
@@ -133,6 +369,24 @@ static void StartDemod(void) {
     /* Activate Power for demodulator */
     CodecSetDemodPower(true);
 
+#ifdef SUPPORT_EDGE_DEMOD
+    /* Arm the pause capture, starting with the SOF */
+    CODEC_DEMOD_DMA.CTRLA = 0;
+    CODEC_DEMOD_DMA.CTRLB |= DMA_CH_TRNIF_bm;
+    CODEC_DEMOD_DMA.TRFCNT = EDGE_BUFFER_SIZE;
+    CODEC_DEMOD_DMA.DESTADDR0 = ((uint16_t) CodecBuffer >> 0) & 0xFF;
+    CODEC_DEMOD_DMA.DESTADDR1 = ((uint16_t) CodecBuffer >> 8) & 0xFF;
+    CODEC_DEMOD_DMA.DESTADDR2 = 0;
+    CODEC_DEMOD_DMA.CTRLA = DMA_CH_ENABLE_bm | DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
+
+    /* EOC timer, restarted by every modulation pause. Its interrupt gets enabled at SOF. */
+    CODEC_TIMER_SAMPLING.CNT = 0;
+    CODEC_TIMER_SAMPLING.PER = EDGE_EOC_SYSTEM_CYCLES - 1;
+    CODEC_TIMER_SAMPLING.INTCTRLA = 0;
+    CODEC_TIMER_SAMPLING.INTCTRLB = 0;
+    CODEC_TIMER_SAMPLING.CTRLA = TC_CLKSEL_DIV1_gc;
+    CODEC_TIMER_SAMPLING.CTRLD = TC_EVACT_RESTART_gc | TC_EVSEL_CH0_gc;
+#else
     /* Configure sampling-timer free running and sync to first modulation-pause. */
     CODEC_TIMER_SAMPLING.CNT = 0;
     CODEC_TIMER_SAMPLING.PER = SAMPLE_RATE_SYSTEM_CYCLES - 1;
@@ -140,6 +394,7 @@ static void StartDemod(void) {
     CODEC_TIMER_SAMPLING.CTRLA = TC_CLKSEL_DIV1_gc;
     CODEC_TIMER_SAMPLING.CTRLD = TC_EVACT_RESTART_gc | TC_EVSEL_CH0_gc;
     CODEC_TIMER_SAMPLING.INTCTRLB = TC_CCAINTLVL_HI_gc;
+#endif
 
     /* Start looking out for modulation pause via interrupt. */
     CODEC_DEMOD_IN_PORT.INT0MASK = CODEC_DEMOD_IN_MASK0;
@@ -149,14 +404,26 @@ ISR(CODEC_DEMOD_IN_INT0_VECT) {
     /* This is the first edge of the first modulation-pause after StartDemod.
      * Now we have time to prepare our timers and variables to start
      * demodulating beginning from one bit-width after this edge. */
+    ISO14443AFrameTimes.ReaderStart = SystemGetTimestamp();
     CodecBufferPtr = CodecBuffer;
     ParityBufferPtr = &CodecBuffer[ISO14443A_BUFFER_PARITY_OFFSET];
+    ParityMask = 0x01;
     DataRegister = 0;
     SampleRegister = 0;
     SamplePosition = 0;
     BitCount = 0;
     IsParityBit = false;
-
+    FrameOverflow = false;
+#ifdef SUPPORT_STREAMING_CRC
+    Checksum = ISO14443A_CRCA_INIT;
+#endif
+
+#ifdef SUPPORT_EDGE_DEMOD
+    /* The capture register still holds the SOF, the next pause is a bit away */
+    EdgeStart = SYSTEM_TIMESTAMP_TIMER.CCA;
+    CODEC_TIMER_SAMPLING.INTFLAGS = TC1_OVFIF_bm;
+    CODEC_TIMER_SAMPLING.INTCTRLA = TC_OVFINTLVL_HI_gc;
+#else
     /* Sampling timer has been preset to sample-rate and has automatically synced
      * to THIS first modulation pause. Thus after exactly one bit-width from here,
      * an OVF is generated. We want to start sampling with the next bit and use the
@@ -168,6 +435,7 @@ ISR(CODEC_DEMOD_IN_INT0_VECT) {
     CODEC_TIMER_SAMPLING.CTRLD = TC_EVACT_OFF_gc;
     CODEC_TIMER_SAMPLING.PERBUF = SAMPLE_RATE_SYSTEM_CYCLES/2 - 1; /* Half bit width */
     CODEC_TIMER_SAMPLING.CCABUF = SAMPLE_RATE_SYSTEM_CYCLES/8 - 10 - 1; /* Compensate for DIGFILT and ISR prolog */
+#endif
 
     /* Setup Frame Delay Timer and wire to EVSYS. Frame delay time is
      * measured from last change in RF field, therefore we use
@@ -197,25 +465,11 @@ ISR(CODEC_TIMER_SAMPLING_CCA_VECT) {
         /* Analyze the sampling register after 2 samples. */
         if ((NewSampleRegister & 0x07) == 0x07) {
             /* No carrier modulation for 3 sample points. EOC! */
+            ISO14443AFrameTimes.ReaderEnd = SystemGetTimestamp();
             CODEC_TIMER_SAMPLING.CTRLA = TC_CLKSEL_OFF_gc;
             CODEC_TIMER_SAMPLING.INTFLAGS = TC0_CCAIF_bm;
 
-            /* By this time, the FDT timer is aligned to the last modulation
-             * edge of the reader. So we disable the auto-synchronization and
-             * let it count the frame delay time in the background, and generate
-             * an interrupt once it has reached the FDT. */
-            CODEC_TIMER_LOADMOD.CTRLD = TC_EVACT_OFF_gc;
-
-            if (LastBit) {
-                CODEC_TIMER_LOADMOD.PER = ISO14443A_FRAME_DELAY_PREV1;
-            } else {
-                CODEC_TIMER_LOADMOD.PER = ISO14443A_FRAME_DELAY_PREV0;
-            }
-
-            LoadModState = LOADMOD_FDT;
-
-            CODEC_TIMER_LOADMOD.INTFLAGS = TC1_OVFIF_bm;
-            CODEC_TIMER_LOADMOD.INTCTRLA = TC_OVFINTLVL_HI_gc;
+            StartFrameDelay(LastBit);
 
             /* Determine if we did not receive a multiple of 8 bits.
              * If this is the case, right-align the remaining data and
@@ -229,12 +483,16 @@ ISR(CODEC_TIMER_SAMPLING_CCA_VECT) {
                     NewDataRegister >>= 1;
                 }
 
-                /* TODO: Prevent buffer overflow */
-                *CodecBufferPtr = NewDataRegister;
+                if (CodecBufferPtr < &CodecBuffer[CODEC_BUFFER_DATA_SIZE]) {
+                    *CodecBufferPtr = NewDataRegister;
+                } else {
+                    FrameOverflow = true;
+                }
             }
 
             /* Signal, that we have finished sampling */
             Flags.DemodFinished = 1;
+            CodecProcessTrigger();
         } else {
             /* Otherwise, we check the two sample bits from the bit before. */
             uint8_t BitSample = NewSampleRegister & 0xC;
@@ -263,8 +521,15 @@ ISR(CODEC_TIMER_SAMPLING_CCA_VECT) {
                     uint16_t NewBitCount = ++BitCount;
                     if ((NewBitCount & 0x07) == 0) {
                         /* We have reached a byte boundary! Store the data register. */
-                        /* TODO: Prevent buffer overflow */
-                        *CodecBufferPtr++ = NewDataRegister;
+                        /* Bytes beyond the data part would run into the parity bits */
+                        if (CodecBufferPtr < &CodecBuffer[CODEC_BUFFER_DATA_SIZE]) {
+                            *CodecBufferPtr++ = NewDataRegister;
+                        } else {
+                            FrameOverflow = true;
+                        }
+#ifdef SUPPORT_STREAMING_CRC
+                        Checksum = ISO14443AUpdateCRCA(Checksum, NewDataRegister);
+#endif
 
                         /* Store bit for determining FDT at EOC and enable parity
                          * handling on next bit. */
@@ -273,8 +538,10 @@ ISR(CODEC_TIMER_SAMPLING_CCA_VECT) {
 
                 } else {
                     /* This is a parity bit. Store it */
-                    /* TODO: Store parity and prevent overflow */
-                    //*ParityBufferPtr++ = Bit;
+                    if (ParityBufferPtr < &CodecBuffer[CODEC_BUFFER_SIZE]) {
+                        ParityStore(Bit);
+                        ParityNext();
+                    }
                     IsParityBit = false;
                 }
             } else {
@@ -295,6 +562,108 @@ ISR(CODEC_TIMER_SAMPLING_CCA_VECT) {
     CODEC_TIMER_SAMPLING.CTRLD = TC_EVACT_RESTART_gc | TC_EVSEL_CH0_gc;
 }
 
+#ifdef SUPPORT_EDGE_DEMOD
+ISR(CODEC_TIMER_SAMPLING_OVF_VECT) {
+    /* No modulation pause for 2.5 bits. EOC! */
+    ISO14443AFrameTimes.ReaderEnd = SystemGetTimestamp();
+    CODEC_TIMER_SAMPLING.CTRLA = TC_CLKSEL_OFF_gc;
+    CODEC_TIMER_SAMPLING.INTCTRLA = 0;
+    CODEC_DEMOD_DMA.CTRLA = 0;
+
+    /* The last pause sits in the second half of a bit for a 1, else it is the
+     * start of the EOC sequence after a 0. The full frame is decoded later on. */
+    uint16_t Ticks = SYSTEM_TIMESTAMP_TIMER.CCA - EdgeStart;
+    uint16_t HalfBits = ((uint32_t) Ticks * EDGE_HALF_BITS_PER_TICK_Q16 + 0x8000) >> 16;
+    StartFrameDelay(HalfBits & 0x01);
+
+    if ((CODEC_DEMOD_DMA.CTRLB & DMA_CH_TRNIF_bm) || (CODEC_DEMOD_DMA.TRFCNT == 0)) {
+        /* Out of captures, the rest of the frame is missing. Drop it */
+        FrameOverflow = true;
+        EdgeCount = EDGE_BUFFER_SIZE;
+    } else {
+        EdgeCount = EDGE_BUFFER_SIZE - CODEC_DEMOD_DMA.TRFCNT;
+    }
+    Flags.DemodFinished = 1;
+    CodecProcessTrigger();
+}
+
+/* Parity bits are collected apart, as their place in the codec buffer may still hold captures */
+typedef struct {
+    uint8_t* Ptr;
+    uint16_t BitCount;
+    uint8_t DataRegister;
+    bool IsParityBit;
+    uint8_t ParityCount;
+    uint8_t Parity[ISO14443A_BUFFER_PARITY_SIZE];
+} EdgeDecoderType;
+
+INLINE void EdgeDecodeBit(EdgeDecoderType* Decoder, uint8_t Bit) {
+    if (!Decoder->IsParityBit) {
+        Decoder->DataRegister >>= 1;
+        Decoder->DataRegister |= (Bit ? 0x80 : 0x00);
+
+        if ((++Decoder->BitCount & 0x07) == 0) {
+            *Decoder->Ptr++ = Decoder->DataRegister;
+#ifdef SUPPORT_STREAMING_CRC
+            Checksum = ISO14443AUpdateCRCA(Checksum, Decoder->DataRegister);
+#endif
+            Decoder->IsParityBit = true;
+        }
+    } else {
+        /* Parity is not checked, as with the sampling demodulator */
+        if (Decoder->ParityCount < ISO14443A_BUFFER_PARITY_SIZE * 8) {
+            ISO14443ASetParityBit(Decoder->Parity, Decoder->ParityCount++, Bit);
+        }
+        Decoder->IsParityBit = false;
+    }
+}
+
+/* Turn the pause captures in the codec buffer into the frame, in place. The output
+ * never catches up with the captures still to be read, as a byte takes at least 4
+ * pauses. Bits with their pause in the second half are 1, all others 0. The SOF is
+ * a pause at half bit 0, so bit n starts at half bit 2n+2. */
+static void EdgeDecode(void) {
+    EdgeDecoderType Decoder = { .Ptr = CodecBuffer, .BitCount = 0, .DataRegister = 0, .IsParityBit = false, .ParityCount = 0 };
+    uint8_t Count = EdgeCount;
+    uint8_t Last = CodecBuffer[0];
+    uint16_t HalfBits = 0;
+    uint16_t NextBit = 0;
+
+    for (uint8_t i = 1; i < Count; i++) {
+        uint8_t Edge = CodecBuffer[i];
+        uint8_t Ticks = Edge - Last;
+        Last = Edge;
+        HalfBits += ((uint16_t) Ticks * EDGE_HALF_BITS_PER_TICK_Q + (1 << (EDGE_HALF_BITS_SHIFT - 1))) >> EDGE_HALF_BITS_SHIFT;
+
+        if ( (HalfBits < 2) || ((HalfBits >> 1) - 1 < NextBit) ) {
+            /* Glitch, no new bit position */
+            continue;
+        }
+
+        uint16_t Bit = (HalfBits >> 1) - 1;
+        while (NextBit < Bit) {
+            /* Bits without a pause in their second half */
+            EdgeDecodeBit(&Decoder, 0);
+            NextBit++;
+        }
+        if ( (i == Count - 1) && !(HalfBits & 0x01) ) {
+            /* Start of the EOC sequence, not part of the frame */
+            break;
+        }
+        EdgeDecodeBit(&Decoder, HalfBits & 0x01);
+        NextBit++;
+    }
+
+    /* Right-align a partial last byte */
+    uint8_t RemainingBits = Decoder.BitCount % 8;
+    if (RemainingBits != 0) {
+        *Decoder.Ptr = Decoder.DataRegister >> (8 - RemainingBits);
+    }
+    memcpy(&CodecBuffer[ISO14443A_BUFFER_PARITY_OFFSET], Decoder.Parity, (Decoder.ParityCount + 7) / 8);
+    BitCount = Decoder.BitCount;
+}
+#endif
+
 ISR(CODEC_TIMER_OVF_VECT) {
     /* Bit rate timer. Output a half bit on the output. */
     uint8_t Temp8;
@@ -302,15 +671,50 @@ ISR(CODEC_TIMER_OVF_VECT) {
 
     switch (LoadModState) {
     case LOADMOD_FDT:
-        /* No data has been produced, but FDT has ended. Switch over to bit-grid aligning. */
-        CODEC_TIMER_LOADMOD.PER = ISO14443A_BIT_GRID_CYCLES - 1;
-        break;
+        if (ProvisionalBitCount == 0) {
+            /* No data has been produced, but FDT has ended. Switch over to bit-grid aligning. */
+            CODEC_TIMER_LOADMOD.PER = ISO14443A_BIT_GRID_CYCLES - 1;
+            FrameDelayElapsed = true;
+            break;
+        }
+
+        /* The application is still busy but left a provisional answer. Send it on time. */
+#ifndef SUPPORT_DMA_LOADMOD
+        /* Already encoded otherwise */
+        BitCount = ProvisionalBitCount;
+        BitSent = 0;
+        CodecBufferPtr = ProvisionalBuffer;
+        ParityBufferPtr = &ProvisionalBuffer[ISO14443A_PROVISIONAL_MAX_BYTES];
+        ParityMask = 0x01;
+#endif
+        ProvisionalBitCount = 0;
+        ProvisionalSent = true;
+        LoadModState = LOADMOD_START;
+
+        /* Fallthrough to start */
 
     case LOADMOD_START:
         /* Application produced data. With this interrupt we are aligned to the bit-grid.
          * Start subcarrier generation and align to bitrate. */
         CODEC_TIMER_LOADMOD.PER = ISO14443A_BIT_RATE_CYCLES / 2 - 1;
         CODEC_SUBCARRIER_TIMER.CTRLA = TC_CLKSEL_EVCH6_gc;
+        ISO14443AFrameTimes.TagStart = SystemGetTimestamp();
+        ISO14443AFrameTimes.TagLate = FrameDelayElapsed;
+
+#ifdef SUPPORT_DMA_LOADMOD
+        /* First half of the start bit, then hand over to the DMA for the remaining ones */
+        CODEC_LOADMOD_PORT.OUTSET = CODEC_LOADMOD_MASK;
+        CODEC_TIMER_LOADMOD.INTCTRLA = 0;
+        LoadmodChunksQueued = 0;
+        LoadmodQueue(&CODEC_LOADMOD_DMA0, LoadmodChunk[0], LoadmodChunkLength[0]);
+        if (LoadmodChunkLength[1] > 0) {
+            LoadmodQueue(&CODEC_LOADMOD_DMA1, LoadmodChunk[1], LoadmodChunkLength[1]);
+        } else {
+            CODEC_LOADMOD_DMA1.TRIGSRC = DMA_CH_TRIGSRC_OFF_gc;
+        }
+        CODEC_LOADMOD_DMA0.CTRLA |= DMA_CH_ENABLE_bm;
+        break;
+#endif
 
         /* Fallthrough to first bit */
 
@@ -324,7 +728,11 @@ ISR(CODEC_TIMER_OVF_VECT) {
         LoadModState = LOADMOD_DATA0;
 
         /* Fetch first byte */
-        DataRegister = *CodecBufferPtr;
+        Temp8 = *CodecBufferPtr;
+        DataRegister = Temp8;
+#ifdef SUPPORT_STREAMING_CRC
+        LoadmodStreamByte(Temp8);
+#endif
         break;
 
     case LOADMOD_DATA0:
@@ -369,7 +777,7 @@ ISR(CODEC_TIMER_OVF_VECT) {
         break;
 
     case LOADMOD_PARITY0:
-        if (*ParityBufferPtr) {
+        if (ParityLoad()) {
             CODEC_LOADMOD_PORT.OUTSET = CODEC_LOADMOD_MASK;
         } else {
             CODEC_LOADMOD_PORT.OUTCLR = CODEC_LOADMOD_MASK;
@@ -379,7 +787,7 @@ ISR(CODEC_TIMER_OVF_VECT) {
         break;
 
     case LOADMOD_PARITY1:
-        if (*ParityBufferPtr) {
+        if (ParityLoad()) {
             CODEC_LOADMOD_PORT.OUTCLR = CODEC_LOADMOD_MASK;
         } else {
             CODEC_LOADMOD_PORT.OUTSET = CODEC_LOADMOD_MASK;
@@ -390,8 +798,12 @@ ISR(CODEC_TIMER_OVF_VECT) {
             LoadModState = LOADMOD_STOP_BIT0;
         } else {
             /* Fetch next data and continue sending bits. */
-            ParityBufferPtr++;
-            DataRegister = *++CodecBufferPtr;
+            ParityNext();
+            Temp8 = *++CodecBufferPtr;
+            DataRegister = Temp8;
+#ifdef SUPPORT_STREAMING_CRC
+            LoadmodStreamByte(Temp8);
+#endif
             LoadModState = LOADMOD_DATA0;
         }
 
@@ -408,15 +820,8 @@ ISR(CODEC_TIMER_OVF_VECT) {
         break;
 
     case LOADMOD_FINISHED:
-        /* We have written all of our bits. Deactivate the loadmod
-         * timer. Also disable the bit-rate interrupt again. And
-         * stop the subcarrier divider. */
-        CODEC_TIMER_LOADMOD.CTRLA = TC_CLKSEL_OFF_gc;
-        CODEC_TIMER_LOADMOD.INTCTRLA = 0;
-        CODEC_SUBCARRIER_TIMER.CTRLA = TC_CLKSEL_OFF_gc;
-
-        /* Signal application that we have finished loadmod */
-        Flags.LoadmodFinished = 1;
+        /* We have written all of our bits. */
+        LoadmodFinish();
         break;
 
     default:
@@ -424,10 +829,80 @@ ISR(CODEC_TIMER_OVF_VECT) {
     }
 }
 
+/* Between the end of a reader frame and the end of the answer */
+bool ISO14443ACodecIsBusy(void) {
+#ifdef SUPPORT_DMA_LOADMOD
+    if (LoadmodChunksQueued != 0) {
+        return true;
+    }
+#endif
+    return Flags.DemodFinished || Flags.LoadmodFinished || (CODEC_TIMER_LOADMOD.INTCTRLA != 0);
+}
+
+void ISO14443ACodecSetProvisional(const uint8_t* Buffer, const uint8_t* Parity, uint8_t AnswerBitCount) {
+    uint8_t ByteCount = (AnswerBitCount + 7) / 8;
+
+    if (ByteCount > ISO14443A_PROVISIONAL_MAX_BYTES) {
+        return;
+    }
+
+    ProvisionalBitCount = 0;
+    ProvisionalBuffer[ISO14443A_PROVISIONAL_MAX_BYTES] = (Parity != NULL) ? Parity[0] : 0x00;
+    for (uint8_t i = 0; i < ByteCount; i++) {
+        ProvisionalBuffer[i] = Buffer[i];
+        if ( (Parity == NULL) && ODD_PARITY(Buffer[i]) ) {
+            ProvisionalBuffer[ISO14443A_PROVISIONAL_MAX_BYTES] |= 1 << i;
+        }
+    }
+#ifdef SUPPORT_DMA_LOADMOD
+    /* Nothing is sent before the application returns, and the answer it returns
+     * is encoded anew if the provisional one does not go out */
+    BitCount = AnswerBitCount;
+    BitSent = 0;
+    CodecBufferPtr = ProvisionalBuffer;
+    ParityBufferPtr = &ProvisionalBuffer[ISO14443A_PROVISIONAL_MAX_BYTES];
+    ParityMask = 0x01;
+    LoadmodPrepare();
+#endif
+    /* Arms the loadmod ISR, single byte store */
+    ProvisionalBitCount = AnswerBitCount;
+}
+
 void ISO14443ACodecInit(void) {
     /* Initialize common peripherals and start listening
      * for incoming data. */
     Initialize();
+#ifdef SUPPORT_EDGE_DEMOD
+    /* Capture the start of modulation pauses with the timestamp timer */
+    SYSTEM_TIMESTAMP_TIMER.CTRLD = TC_EVACT_CAPT_gc | TC_EVSEL_CH0_gc;
+    SYSTEM_TIMESTAMP_TIMER.CTRLB |= TC0_CCAEN_bm;
+    DMA.CTRL |= DMA_ENABLE_bm;
+    CODEC_DEMOD_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_INC_gc;
+    CODEC_DEMOD_DMA.TRIGSRC = DMA_CH_TRIGSRC_TCD0_CCA_gc;
+    CODEC_DEMOD_DMA.SRCADDR0 = ((uint16_t) &SYSTEM_TIMESTAMP_TIMER.CCA >> 0) & 0xFF;
+    CODEC_DEMOD_DMA.SRCADDR1 = ((uint16_t) &SYSTEM_TIMESTAMP_TIMER.CCA >> 8) & 0xFF;
+    CODEC_DEMOD_DMA.SRCADDR2 = 0;
+#endif
+#ifdef SUPPORT_DMA_LOADMOD
+    /* Half bit values go to the toggle register, so that the DMA touches no other pin */
+    DMA.CTRL |= DMA_ENABLE_bm | CODEC_LOADMOD_DMA_DBUFMODE;
+    CODEC_LOADMOD_DMA0.CTRLA = 0;
+    CODEC_LOADMOD_DMA1.CTRLA = 0;
+    CODEC_LOADMOD_DMA0.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_INC_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    CODEC_LOADMOD_DMA1.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_INC_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    CODEC_LOADMOD_DMA0.TRIGSRC = CODEC_LOADMOD_DMA_TRIGSRC;
+    CODEC_LOADMOD_DMA1.TRIGSRC = CODEC_LOADMOD_DMA_TRIGSRC;
+    CODEC_LOADMOD_DMA0.SRCADDR2 = 0;
+    CODEC_LOADMOD_DMA1.SRCADDR2 = 0;
+    CODEC_LOADMOD_DMA0.DESTADDR0 = ((uint16_t) &CODEC_LOADMOD_PORT.OUTTGL >> 0) & 0xFF;
+    CODEC_LOADMOD_DMA0.DESTADDR1 = ((uint16_t) &CODEC_LOADMOD_PORT.OUTTGL >> 8) & 0xFF;
+    CODEC_LOADMOD_DMA0.DESTADDR2 = 0;
+    CODEC_LOADMOD_DMA1.DESTADDR0 = ((uint16_t) &CODEC_LOADMOD_PORT.OUTTGL >> 0) & 0xFF;
+    CODEC_LOADMOD_DMA1.DESTADDR1 = ((uint16_t) &CODEC_LOADMOD_PORT.OUTTGL >> 8) & 0xFF;
+    CODEC_LOADMOD_DMA1.DESTADDR2 = 0;
+    CODEC_LOADMOD_DMA0.CTRLB = DMA_CH_TRNINTLVL_HI_gc;
+    CODEC_LOADMOD_DMA1.CTRLB = DMA_CH_TRNINTLVL_HI_gc;
+#endif
     StartDemod();
 }
 
@@ -436,34 +911,109 @@ void ISO14443ACodecTask(void) {
         Flags.DemodFinished = 0;
         /* Reception finished. Process the received bytes */
         CodecSetDemodPower(false);
+#ifdef SUPPORT_EDGE_DEMOD
+        EdgeDecode();
+#endif
 
         uint16_t DemodBitCount = BitCount;
         uint16_t AnswerBitCount = ISO14443A_APP_NO_RESPONSE;
-
-        if (DemodBitCount > 0) {
+#ifdef SUPPORT_STREAMING_CRC
+        uint8_t* AnswerCRCPtr = NULL;
+        bool AnswerCustomParity = false;
+#endif
+
+        if (FrameOverflow) {
+            /* Truncated, the application must not see it. Listen for the next frame */
+            PERF_COUNT(FramesDropped);
+        } else if (DemodBitCount > 0) {
+            PERF_COUNT_CONFIG(Frames);
+#ifdef SUPPORT_LIVE_TRACE
+            TraceFrame(TRACE_RECORD_READER, ISO14443AFrameTimes.ReaderStart, CodecBuffer, DemodBitCount);
+#endif
+#ifdef SUPPORT_LATENCY_STATS
+            /* The answer overwrites the command */
+            uint8_t Command = CodecBuffer[0];
+#endif
+#ifdef SUPPORT_STREAMING_CRC
+            /* The CRC runs over the frame and its CRC, so that it ends on 0 when valid */
+            ISO14443AFrameCRCA.BitCount = DemodBitCount;
+            ISO14443AFrameCRCA.Ok = ((DemodBitCount & 0x07) == 0) && (Checksum == 0);
+            /* A provisional answer goes out as given */
+            CRCBufferPtr = NULL;
+            CustomParity = true;
+#endif
 
             /* Call application if we received data */
             AnswerBitCount = ApplicationProcess(CodecBuffer, DemodBitCount);
+            /* From here on the loadmod ISR does not pick up the provisional answer anymore */
+            ProvisionalBitCount = 0;
+#ifdef SUPPORT_LATENCY_STATS
+            LatencyProcessed(Command, SystemGetTimestamp() - ISO14443AFrameTimes.ReaderEnd,
+                             AnswerBitCount != ISO14443A_APP_NO_RESPONSE);
+#endif
+            if (AnswerBitCount & ISO14443A_APP_APPEND_CRCA) {
+                /* Application left the CRC to us */
+                AnswerBitCount &= ~ISO14443A_APP_APPEND_CRCA;
+#ifdef SUPPORT_STREAMING_CRC
+                AnswerCRCPtr = &CodecBuffer[AnswerBitCount / 8];
+#else
+                ISO14443AAppendCRCA(CodecBuffer, AnswerBitCount / 8);
+#endif
+                AnswerBitCount += ISO14443A_CRCA_SIZE * 8;
+            }
+
             if (AnswerBitCount & ISO14443A_APP_CUSTOM_PARITY) {
                 /* Application has generated it's own parity bits.
                  * Clear this option bit. */
                 AnswerBitCount &= ~ISO14443A_APP_CUSTOM_PARITY;
+#ifdef SUPPORT_STREAMING_CRC
+                AnswerCustomParity = true;
+#endif
             } else {
+#ifndef SUPPORT_STREAMING_CRC
                 /* We have to generate the parity bits ourself */
+                uint8_t* Parity = &CodecBuffer[ISO14443A_BUFFER_PARITY_OFFSET];
+                uint8_t Mask = 0x01;
+
                 for (uint8_t i = 0; i < (AnswerBitCount / 8); i++) {
                     /* For each whole byte, generate a parity bit. */
-                    CodecBuffer[ISO14443A_BUFFER_PARITY_OFFSET + i] = ODD_PARITY(CodecBuffer[i]);
+                    if (Mask == 0x01) {
+                        *Parity = 0x00;
+                    }
+                    if (ODD_PARITY(CodecBuffer[i])) {
+                        *Parity |= Mask;
+                    }
+                    Mask <<= 1;
+                    if (Mask == 0) {
+                        Mask = 0x01;
+                        Parity++;
+                    }
                 }
+#endif
             }
         } else {
             ApplicationReset();
         }
 
-        if (AnswerBitCount != ISO14443A_APP_NO_RESPONSE) {
+        if (ProvisionalSent) {
+            /* The provisional answer stands in for the one of the application and
+             * is out or on its way. Demodulation restarts once it has been sent. */
+            PERF_COUNT(FrameDelayFallbacks);
+        } else if (AnswerBitCount != ISO14443A_APP_NO_RESPONSE) {
             BitCount = AnswerBitCount;
             BitSent = 0;
             CodecBufferPtr = CodecBuffer;
             ParityBufferPtr = &CodecBuffer[ISO14443A_BUFFER_PARITY_OFFSET];
+            ParityMask = 0x01;
+#ifdef SUPPORT_STREAMING_CRC
+            /* Parity and CRC get computed as the bytes are sent */
+            Checksum = ISO14443A_CRCA_INIT;
+            CRCBufferPtr = AnswerCRCPtr;
+            CustomParity = AnswerCustomParity;
+#endif
+#ifdef SUPPORT_DMA_LOADMOD
+            LoadmodPrepare();
+#endif
             LoadModState = LOADMOD_START;
         } else {
             /* No data to be processed. Disable loadmodding and start listening again */
@@ -476,6 +1026,17 @@ void ISO14443ACodecTask(void) {
 
     if (Flags.LoadmodFinished) {
         Flags.LoadmodFinished = 0;
+        if (ISO14443AFrameTimes.TagLate) {
+            PERF_COUNT(FrameDelayMisses);
+        }
+#ifdef SUPPORT_LATENCY_STATS
+        LatencyAnswered(ISO14443AFrameTimes.TagStart - ISO14443AFrameTimes.ReaderEnd, ISO14443AFrameTimes.TagLate);
+#endif
+#ifdef SUPPORT_LIVE_TRACE
+        /* The answer is still in the buffer until demodulation restarts */
+        TraceFrame(TRACE_RECORD_TAG, ISO14443AFrameTimes.TagStart, ProvisionalSent ? ProvisionalBuffer : CodecBuffer, BitCount);
+#endif
+        ProvisionalSent = false;
         /* Load modulation has been finished. Stop it and start to listen
          * for incoming data again. */
         StartDemod();
@@ -12,11 +12,62 @@
 
 #define ISO14443A_APP_NO_RESPONSE       0x0000
 #define ISO14443A_APP_CUSTOM_PARITY     0x1000
+#define ISO14443A_APP_APPEND_CRCA       0x2000 /* The codec sends the CRC_A after the data, not with custom parity */
 
-#define ISO14443A_BUFFER_PARITY_OFFSET    (CODEC_BUFFER_SIZE/2)
+/* Parity bits are packed, LSB first: the one of byte n is bit n % 8 of parity byte n / 8 */
+#define ISO14443A_BUFFER_PARITY_OFFSET    CODEC_BUFFER_DATA_SIZE
+#define ISO14443A_BUFFER_PARITY_SIZE      (CODEC_BUFFER_DATA_SIZE / 8)
+
+#define ISO14443A_PROVISIONAL_MAX_BYTES   4
+
+/* Timestamps (see SystemGetTimestamp) taken by the codec ISRs at the start and
+ * end of the last frame in each direction. The reader frame ones are valid from
+ * the application call on, the tag frame ones after the answer was sent. */
+typedef struct {
+    uint32_t ReaderStart;
+    uint32_t ReaderEnd;
+    uint32_t TagStart;
+    uint32_t TagEnd;
+    bool TagLate; /* The answer missed the frame delay time and went out on a later bit grid slot */
+} ISO14443AFrameTimesType;
+
+extern volatile ISO14443AFrameTimesType ISO14443AFrameTimes;
+
+#ifdef SUPPORT_STREAMING_CRC
+/* The reader frame handed to the application, and whether it ends with a valid
+ * CRC_A. Computed while demodulating. */
+typedef struct {
+    uint16_t BitCount;
+    bool Ok;
+} ISO14443AFrameCRCAType;
+
+extern ISO14443AFrameCRCAType ISO14443AFrameCRCA;
+#endif
 
 /* Codec Interface */
 void ISO14443ACodecInit(void);
 void ISO14443ACodecTask(void);
+bool ISO14443ACodecIsBusy(void);
+
+INLINE uint8_t ISO14443AGetParityBit(const uint8_t* Parity, uint8_t Index) {
+    return (Parity[Index / 8] >> (Index % 8)) & 0x01;
+}
+
+INLINE void ISO14443ASetParityBit(uint8_t* Parity, uint8_t Index, uint8_t Bit) {
+    uint8_t Mask = 1 << (Index % 8);
+
+    if (Bit) {
+        Parity[Index / 8] |= Mask;
+    } else {
+        Parity[Index / 8] &= ~Mask;
+    }
+}
+
+/* Registers, from within the application process function, the answer to be sent
+ * in case the function is still running when the frame delay time ends. Meant for
+ * answers known before slow work, like the ACK of a MIFARE WRITE before the memory
+ * write. Once sent, the answer returned by the application is dropped. Parity
+ * is packed as in the codec buffer, NULL means odd parity over Buffer. */
+void ISO14443ACodecSetProvisional(const uint8_t* Buffer, const uint8_t* Parity, uint8_t BitCount);
 
 #endif
@@ -91,17 +91,18 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecInitFunc = ISO14443ACodecInit,
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareUltralightAppInit,
-    .ApplicationResetFunc = MifareUltralightAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
-    .ApplicationTickFunc = ApplicationTickDummy,
+    .ApplicationResetFunc = Type2TagAppReset,
+    .ApplicationTaskFunc = Type2TagAppTask,
+    .ApplicationTickFunc = Type2TagAppTick,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
-    .ApplicationProcessFunc = MifareUltralightAppProcess,
-    .ApplicationGetUidFunc = MifareUltralightGetUid,
-    .ApplicationSetUidFunc = MifareUltralightSetUid,
-    .ApplicationGetSakFunc = MifareUltralightGetSak,
-    .ApplicationSetSakFunc = MifareUltralightSetSak,
-    .ApplicationGetAtqaFunc = MifareUltralightGetAtqa,
-    .ApplicationSetAtqaFunc = MifareUltralightSetAtqa,
+    .ApplicationFlushFunc = Type2TagAppFlush,
+    .ApplicationProcessFunc = Type2TagAppProcess,
+    .ApplicationGetUidFunc = Type2TagGetUid,
+    .ApplicationSetUidFunc = Type2TagSetUid,
+    .ApplicationGetSakFunc = Type2TagGetSak,
+    .ApplicationSetSakFunc = Type2TagSetSak,
+    .ApplicationGetAtqaFunc = Type2TagGetAtqa,
+    .ApplicationSetAtqaFunc = Type2TagSetAtqa,
     .UidSize = MIFARE_ULTRALIGHT_UID_SIZE,
     .CardMemorySize = MIFARE_ULTRALIGHT_MEM_SIZE,
     .WorkingMemorySize = MIFARE_ULTRALIGHT_PWD_SIZE,
@@ -111,40 +112,42 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecInitFunc = ISO14443ACodecInit,
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareUltralightEV11AppInit,
-    .ApplicationResetFunc = MifareUltralightAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
-    .ApplicationTickFunc = ApplicationTickDummy,
+    .ApplicationResetFunc = Type2TagAppReset,
+    .ApplicationTaskFunc = Type2TagAppTask,
+    .ApplicationTickFunc = Type2TagAppTick,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
-    .ApplicationProcessFunc = MifareUltralightAppProcess,
-    .ApplicationGetUidFunc = MifareUltralightGetUid,
-    .ApplicationSetUidFunc = MifareUltralightSetUid,
-    .ApplicationGetSakFunc = MifareUltralightGetSak,
-    .ApplicationSetSakFunc = MifareUltralightSetSak,
-    .ApplicationGetAtqaFunc = MifareUltralightGetAtqa,
-    .ApplicationSetAtqaFunc = MifareUltralightSetAtqa,
+    .ApplicationFlushFunc = Type2TagAppFlush,
+    .ApplicationProcessFunc = Type2TagAppProcess,
+    .ApplicationGetUidFunc = Type2TagGetUid,
+    .ApplicationSetUidFunc = Type2TagSetUid,
+    .ApplicationGetSakFunc = Type2TagGetSak,
+    .ApplicationSetSakFunc = Type2TagSetSak,
+    .ApplicationGetAtqaFunc = Type2TagGetAtqa,
+    .ApplicationSetAtqaFunc = Type2TagSetAtqa,
     .UidSize = MIFARE_ULTRALIGHT_UID_SIZE,
     .CardMemorySize = MIFARE_ULTRALIGHT_EV11_MEM_SIZE,
-    .WorkingMemorySize = MIFARE_ULTRALIGHT_PWD_SIZE,
+    .WorkingMemorySize = MIFARE_ULTRALIGHT_EV1_WORKING_SIZE,
     .ReadOnly = false
 },
 [CONFIG_MF_ULTRALIGHT_EV1_164B] = {
     .CodecInitFunc = ISO14443ACodecInit,
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareUltralightEV12AppInit,
-    .ApplicationResetFunc = MifareUltralightAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
-    .ApplicationTickFunc = ApplicationTickDummy,
+    .ApplicationResetFunc = Type2TagAppReset,
+    .ApplicationTaskFunc = Type2TagAppTask,
+    .ApplicationTickFunc = Type2TagAppTick,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
-    .ApplicationProcessFunc = MifareUltralightAppProcess,
-    .ApplicationGetUidFunc = MifareUltralightGetUid,
-    .ApplicationSetUidFunc = MifareUltralightSetUid,
-    .ApplicationGetSakFunc = MifareUltralightGetSak,
-    .ApplicationSetSakFunc = MifareUltralightSetSak,
-    .ApplicationGetAtqaFunc = MifareUltralightGetAtqa,
-    .ApplicationSetAtqaFunc = MifareUltralightSetAtqa,
+    .ApplicationFlushFunc = Type2TagAppFlush,
+    .ApplicationProcessFunc = Type2TagAppProcess,
+    .ApplicationGetUidFunc = Type2TagGetUid,
+    .ApplicationSetUidFunc = Type2TagSetUid,
+    .ApplicationGetSakFunc = Type2TagGetSak,
+    .ApplicationSetSakFunc = Type2TagSetSak,
+    .ApplicationGetAtqaFunc = Type2TagGetAtqa,
+    .ApplicationSetAtqaFunc = Type2TagSetAtqa,
     .UidSize = MIFARE_ULTRALIGHT_UID_SIZE,
     .CardMemorySize = MIFARE_ULTRALIGHT_EV12_MEM_SIZE,
-    .WorkingMemorySize = MIFARE_ULTRALIGHT_PWD_SIZE,
+    .WorkingMemorySize = MIFARE_ULTRALIGHT_EV1_WORKING_SIZE,
     .ReadOnly = false
 },
 #endif
@@ -154,9 +157,10 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareClassicAppInit1K,
     .ApplicationResetFunc = MifareClassicAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
+    .ApplicationTaskFunc = MifareClassicAppTask,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
+    .ApplicationFlushFunc = MifareClassicAppFlush,
     .ApplicationProcessFunc = MifareClassicAppProcess,
     .ApplicationGetUidFunc = MifareClassicGetUid,
     .ApplicationSetUidFunc = MifareClassicSetUid,
@@ -174,9 +178,10 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareClassicAppInit1K,
     .ApplicationResetFunc = MifareClassicAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
+    .ApplicationTaskFunc = MifareClassicAppTask,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
+    .ApplicationFlushFunc = MifareClassicAppFlush,
     .ApplicationProcessFunc = MifareClassicAppProcess,
     .ApplicationGetUidFunc = MifareClassicGetUid,
     .ApplicationSetUidFunc = MifareClassicSetUid,
@@ -194,9 +199,10 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareClassicAppInit4K,
     .ApplicationResetFunc = MifareClassicAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
+    .ApplicationTaskFunc = MifareClassicAppTask,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
+    .ApplicationFlushFunc = MifareClassicAppFlush,
     .ApplicationProcessFunc = MifareClassicAppProcess,
     .ApplicationGetUidFunc = MifareClassicGetUid,
     .ApplicationSetUidFunc = MifareClassicSetUid,
@@ -214,9 +220,10 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareClassicAppInit4K,
     .ApplicationResetFunc = MifareClassicAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
+    .ApplicationTaskFunc = MifareClassicAppTask,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
+    .ApplicationFlushFunc = MifareClassicAppFlush,
     .ApplicationProcessFunc = MifareClassicAppProcess,
     .ApplicationGetUidFunc = MifareClassicGetUid,
     .ApplicationSetUidFunc = MifareClassicSetUid,
@@ -234,9 +241,10 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareClassicAppInitMini,
     .ApplicationResetFunc = MifareClassicAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
+    .ApplicationTaskFunc = MifareClassicAppTask,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
+    .ApplicationFlushFunc = MifareClassicAppFlush,
     .ApplicationProcessFunc = MifareClassicAppProcess,
     .ApplicationGetUidFunc = MifareClassicGetUid,
     .ApplicationSetUidFunc = MifareClassicSetUid,
@@ -255,17 +263,17 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecInitFunc = ISO14443ACodecInit,
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = NTAG213AppInit,
-    .ApplicationResetFunc = NTAG21xAppReset,
+    .ApplicationResetFunc = Type2TagAppReset,
     .ApplicationTaskFunc = ApplicationTaskDummy,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
-    .ApplicationProcessFunc = NTAG21xAppProcess,
-    .ApplicationGetUidFunc = NTAG21xGetUid,
-    .ApplicationSetUidFunc = NTAG21xSetUid,
-    .ApplicationGetSakFunc = ApplicationGetSakDummy,
-    .ApplicationSetSakFunc = ApplicationSetSakDummy,
-    .ApplicationGetAtqaFunc = ApplicationGetAtqaDummy,
-    .ApplicationSetAtqaFunc = ApplicationSetAtqaDummy,
+    .ApplicationProcessFunc = Type2TagAppProcess,
+    .ApplicationGetUidFunc = Type2TagGetUid,
+    .ApplicationSetUidFunc = Type2TagSetUid,
+    .ApplicationGetSakFunc = Type2TagGetSak,
+    .ApplicationSetSakFunc = Type2TagSetSak,
+    .ApplicationGetAtqaFunc = Type2TagGetAtqa,
+    .ApplicationSetAtqaFunc = Type2TagSetAtqa,
     .UidSize = NTAG21x_UID_SIZE,
     .CardMemorySize = NTAG213_MEM_SIZE,
     .WorkingMemorySize = MEMORY_NO_MEMORY,
@@ -277,17 +285,17 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecInitFunc = ISO14443ACodecInit,
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = NTAG215AppInit,
-    .ApplicationResetFunc = NTAG21xAppReset,
+    .ApplicationResetFunc = Type2TagAppReset,
     .ApplicationTaskFunc = ApplicationTaskDummy,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
-    .ApplicationProcessFunc = NTAG21xAppProcess,
-    .ApplicationGetUidFunc = NTAG21xGetUid,
-    .ApplicationSetUidFunc = NTAG21xSetUid,
-    .ApplicationGetSakFunc = ApplicationGetSakDummy,
-    .ApplicationSetSakFunc = ApplicationSetSakDummy,
-    .ApplicationGetAtqaFunc = ApplicationGetAtqaDummy,
-    .ApplicationSetAtqaFunc = ApplicationSetAtqaDummy,
+    .ApplicationProcessFunc = Type2TagAppProcess,
+    .ApplicationGetUidFunc = Type2TagGetUid,
+    .ApplicationSetUidFunc = Type2TagSetUid,
+    .ApplicationGetSakFunc = Type2TagGetSak,
+    .ApplicationSetSakFunc = Type2TagSetSak,
+    .ApplicationGetAtqaFunc = Type2TagGetAtqa,
+    .ApplicationSetAtqaFunc = Type2TagSetAtqa,
     .UidSize = NTAG21x_UID_SIZE,
     .CardMemorySize = NTAG215_MEM_SIZE,
     .WorkingMemorySize = MEMORY_NO_MEMORY,
@@ -299,17 +307,17 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecInitFunc = ISO14443ACodecInit,
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = NTAG216AppInit,
-    .ApplicationResetFunc = NTAG21xAppReset,
+    .ApplicationResetFunc = Type2TagAppReset,
     .ApplicationTaskFunc = ApplicationTaskDummy,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
-    .ApplicationProcessFunc = NTAG21xAppProcess,
-    .ApplicationGetUidFunc = NTAG21xGetUid,
-    .ApplicationSetUidFunc = NTAG21xSetUid,
-    .ApplicationGetSakFunc = ApplicationGetSakDummy,
-    .ApplicationSetSakFunc = ApplicationSetSakDummy,
-    .ApplicationGetAtqaFunc = ApplicationGetAtqaDummy,
-    .ApplicationSetAtqaFunc = ApplicationSetAtqaDummy,
+    .ApplicationProcessFunc = Type2TagAppProcess,
+    .ApplicationGetUidFunc = Type2TagGetUid,
+    .ApplicationSetUidFunc = Type2TagSetUid,
+    .ApplicationGetSakFunc = Type2TagGetSak,
+    .ApplicationSetSakFunc = Type2TagSetSak,
+    .ApplicationGetAtqaFunc = Type2TagGetAtqa,
+    .ApplicationSetAtqaFunc = Type2TagSetAtqa,
     .UidSize = NTAG21x_UID_SIZE,
     .CardMemorySize = NTAG216_MEM_SIZE,
     .WorkingMemorySize = MEMORY_NO_MEMORY,
@@ -322,9 +330,10 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareClassicAppDetectionInit,
     .ApplicationResetFunc = MifareClassicAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
+    .ApplicationTaskFunc = MifareClassicAppTask,
     .ApplicationTickFunc = ApplicationTickDummy,
     .ApplicationButtonFunc = ApplicationButtonFuncDummy,
+    .ApplicationFlushFunc = MifareClassicAppFlush,
     .ApplicationProcessFunc = MifareClassicAppProcess,
     .ApplicationGetUidFunc = MifareClassicGetUid,
     .ApplicationSetUidFunc = MifareClassicSetUid,
@@ -344,9 +353,10 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareClassicAppBruteInit,
     .ApplicationResetFunc = MifareClassicAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
+    .ApplicationTaskFunc = MifareClassicAppTask,
     .ApplicationTickFunc = MifareClassicAppBruteTick,
     .ApplicationButtonFunc = MifareClassicAppBruteToggle,
+    .ApplicationFlushFunc = MifareClassicAppFlush,
     .ApplicationProcessFunc = MifareClassicAppProcess,
     .ApplicationGetUidFunc = MifareClassicGetUid,
     .ApplicationSetUidFunc = MifareClassicSetUid,
@@ -366,9 +376,10 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
     .CodecTaskFunc = ISO14443ACodecTask,
     .ApplicationInitFunc = MifareClassicAppLogInit,
     .ApplicationResetFunc = MifareClassicAppReset,
-    .ApplicationTaskFunc = ApplicationTaskDummy,
-    .ApplicationTickFunc = MifareClassicAppLogWriteLines,
+    .ApplicationTaskFunc = MifareClassicAppLogTask,
+    .ApplicationTickFunc = MifareClassicAppLogTick,
     .ApplicationButtonFunc = MifareClassicAppLogToggle,
+    .ApplicationFlushFunc = MifareClassicAppLogFlush,
     .ApplicationProcessFunc = MifareClassicAppProcess,
     .ApplicationGetUidFunc = MifareClassicGetUid,
     .ApplicationSetUidFunc = MifareClassicSetUid,
@@ -393,13 +404,19 @@ void ConfigurationInit(void)
 
 void ConfigurationSetById( ConfigurationEnum Configuration )
 {
+    /* The codec interrupt calls through ActiveConfiguration */
+    CodecProcessLock();
     GlobalSettings.ActiveSettingPtr->Configuration = Configuration;
 
+    /* Let the leaving application commit what it still holds in RAM */
+    ApplicationFlush();
+
     /* Copy struct from PROGMEM to RAM */
     memcpy_P(&ActiveConfiguration, &ConfigurationTable[Configuration], sizeof(ConfigurationType));
 
     CodecInit();
     ApplicationInit();
+    CodecProcessUnlock();
 }
 
 void ConfigurationGetByName(char* Configuration, uint16_t BufferSize)
@@ -407,6 +424,11 @@ void ConfigurationGetByName(char* Configuration, uint16_t BufferSize)
     MapIdToText(ConfigurationMap, ARRAY_COUNT(ConfigurationMap), GlobalSettings.ActiveSettingPtr->Configuration, Configuration, BufferSize);
 }
 
+void ConfigurationGetNameForId(ConfigurationEnum Configuration, char* Name, uint16_t BufferSize)
+{
+    MapIdToText(ConfigurationMap, ARRAY_COUNT(ConfigurationMap), Configuration, Name, BufferSize);
+}
+
 bool ConfigurationSetByName(const char* Configuration)
 {
     MapIdType Id;
@@ -94,6 +94,9 @@ typedef struct {
     void (*ApplicationTickFunc) (void);
     /** Function that is called when the "CARD_FUNCTION" button is pushed */
     void (*ApplicationButtonFunc) (void);
+    /** Optional function that commits application data only held in RAM to memory. It is called before
+     *  the terminal accesses the memory and before the active setting or configuration changes. */
+    void (*ApplicationFlushFunc) (void);
     /** This function does two important things. It gets called by the codec.
      *  The first task is to deliver data that have been received by the codec module to
      *  the application module. The application then can decide how to answer to these data and return
@@ -160,6 +163,7 @@ extern ConfigurationType ActiveConfiguration;
 void ConfigurationInit(void);
 void ConfigurationSetById(ConfigurationEnum Configuration);
 void ConfigurationGetByName(char* Configuration, uint16_t BufferSize);
+void ConfigurationGetNameForId(ConfigurationEnum Configuration, char* Name, uint16_t BufferSize);
 bool ConfigurationSetByName(const char* Configuration);
 void ConfigurationGetList(char* ConfigurationList, uint16_t BufferSize);
 uint32_t ConfigurationTableGetCardMemorySizeForId(ConfigurationEnum Configuration);
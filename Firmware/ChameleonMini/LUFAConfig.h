@@ -55,8 +55,14 @@
 //        #define NO_CLASS_DRIVER_AUTOFLUSH
 
         /* General USB Driver Related Tokens: */
+        #if defined(SUPPORT_USB_INTERRUPT)
+        /* Terminal is serviced from the USB interrupts, keep them below the codec */
+        #define USE_STATIC_OPTIONS               \
+            (USB_OPT_BUSEVENT_PRILOW | USB_DEVICE_OPT_FULLSPEED | USB_OPT_PLLCLKSRC /*USB_OPT_RC32MCLKSRC*/)
+        #else
         #define USE_STATIC_OPTIONS               \
             (USB_OPT_BUSEVENT_PRIMED | USB_DEVICE_OPT_FULLSPEED | USB_OPT_PLLCLKSRC /*USB_OPT_RC32MCLKSRC*/)
+        #endif
         #define USB_DEVICE_ONLY
 //        #define USB_STREAM_TIMEOUT_MS            {Insert Value Here}
 //        #define NO_LIMITED_CONTROLLER_CONNECT
@@ -52,8 +52,8 @@
 		/** Endpoint address for the CDC data interface RX (data OUT) endpoint. */
 		#define CDC_RX_EPADDR                  (ENDPOINT_DIR_OUT | 4)
 
-		/** Size of the CDC data interface TX and RX data endpoint banks, in bytes. */
-		#define CDC_TXRX_EPSIZE                16
+		/** Size of the CDC data interface TX and RX data endpoint banks, in bytes. Full speed bulk maximum. */
+		#define CDC_TXRX_EPSIZE                64
 
 		/** Size of the CDC control interface notification endpoint bank, in bytes. */
 		#define CDC_NOTIFICATION_EPSIZE        8
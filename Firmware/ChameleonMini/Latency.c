@@ -0,0 +1,98 @@
+/*
+ * Latency.c
+ *
+ *  Fed by the codec task. Durations come from the timestamps the codec ISRs take,
+ *  so the statistics do not add anything to the ISRs themselves.
+ */
+
+#ifdef SUPPORT_LATENCY_STATS
+
+#include <string.h>
+#include "Latency.h"
+#include "System.h"
+
+#define LATENCY_NO_SLOT     0xFF
+
+static LatencySlotType LatencySlots[LATENCY_SLOTS];
+static uint8_t LatencyPendingSlot = LATENCY_NO_SLOT;
+static uint32_t LatencyFrames = 0;
+static uint32_t LatencyMissed = 0;
+
+INLINE void LatencyCount(uint16_t * Counter) {
+    if (*Counter < UINT16_MAX) {
+        (*Counter)++;
+    }
+}
+
+/* Bin 0 up to LATENCY_BIN0_US, then one bin per doubling */
+static uint8_t LatencyBin(uint32_t Duration) {
+    uint32_t Micros = Duration / SYSTEM_TIMESTAMP_PER_US;
+    uint8_t Bin = 0;
+
+    Micros /= LATENCY_BIN0_US;
+    while ( (Micros > 0) && (Bin < (LATENCY_BINS - 1)) ) {
+        Micros >>= 1;
+        Bin++;
+    }
+    return Bin;
+}
+
+static uint8_t LatencyFindSlot(uint8_t Command) {
+    uint8_t Slot;
+    for (Slot = 0; Slot < (LATENCY_SLOTS - 1); Slot++) {
+        if (!LatencySlots[Slot].Used) {
+            LatencySlots[Slot].Used = true;
+            LatencySlots[Slot].Command = Command;
+            return Slot;
+        }
+        if (LatencySlots[Slot].Command == Command) {
+            return Slot;
+        }
+    }
+    LatencySlots[Slot].Used = true;
+    return Slot;
+}
+
+void LatencyReset(void) {
+    memset(LatencySlots, 0, sizeof(LatencySlots));
+    LatencyPendingSlot = LATENCY_NO_SLOT;
+    LatencyFrames = 0;
+    LatencyMissed = 0;
+}
+
+void LatencyProcessed(uint8_t Command, uint32_t Duration, bool Answered) {
+    uint8_t Slot = LatencyFindSlot(Command);
+
+    LatencyFrames++;
+    LatencyCount(&LatencySlots[Slot].Frames);
+    LatencyCount(&LatencySlots[Slot].Process[LatencyBin(Duration)]);
+    LatencyPendingSlot = Answered ? Slot : LATENCY_NO_SLOT;
+}
+
+void LatencyAnswered(uint32_t Duration, bool Late) {
+    uint8_t Slot = LatencyPendingSlot;
+
+    if (Slot == LATENCY_NO_SLOT) {
+        return;
+    }
+    LatencyPendingSlot = LATENCY_NO_SLOT;
+    LatencyCount(&LatencySlots[Slot].Answer[LatencyBin(Duration)]);
+    if (Late) {
+        LatencyMissed++;
+        LatencyCount(&LatencySlots[Slot].Missed);
+    }
+}
+
+const LatencySlotType * LatencyGetSlot(uint8_t Slot) {
+    return &LatencySlots[Slot];
+}
+
+uint32_t LatencyGetFrames(void) {
+    return LatencyFrames;
+}
+
+uint32_t LatencyGetMissed(void) {
+    return LatencyMissed;
+}
+
+#endif /* SUPPORT_LATENCY_STATS */
@@ -0,0 +1,39 @@
+/*
+ * Latency.h
+ *
+ *  Frame turnaround statistics, per reader command byte: time from the end of the
+ *  reader frame to the return of the application and to the start of the answer.
+ *  Read with LATENCY?, cleared with LATENCY=RESET.
+ */
+
+#ifdef SUPPORT_LATENCY_STATS
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include "Common.h"
+
+#define LATENCY_SLOTS               8 /* Command bytes tracked, the last slot collects all others */
+#define LATENCY_BINS                8 /* Log scale, see LATENCY_BIN0_US */
+#define LATENCY_BIN0_US             4 /* Upper bound of the first bin, doubling with every further bin */
+
+typedef struct {
+    bool Used;
+    uint8_t Command;
+    uint16_t Frames;
+    uint16_t Missed; /* Answers that could not go out right at the frame delay time */
+    uint16_t Process[LATENCY_BINS];
+    uint16_t Answer[LATENCY_BINS];
+} LatencySlotType;
+
+void LatencyReset(void);
+void LatencyProcessed(uint8_t Command, uint32_t Duration, bool Answered);
+void LatencyAnswered(uint32_t Duration, bool Late);
+
+const LatencySlotType * LatencyGetSlot(uint8_t Slot);
+uint32_t LatencyGetFrames(void);
+uint32_t LatencyGetMissed(void);
+
+#endif /* LATENCY_H_ */
+
+#endif /* SUPPORT_LATENCY_STATS */
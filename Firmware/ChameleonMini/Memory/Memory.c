@@ -166,6 +166,8 @@ bool AppMemoryDownloadXModem( uint32_t (*getSize)(void), bool (*memRead)(void*,
     uint32_t AvailBytes = (*getSize)();
     if(Address < AvailBytes) {
         uint32_t BytesLeft = MIN(ByteCount, AvailBytes - Address);
+        /* The reader may have written meanwhile, send what the card holds now */
+        ApplicationFlush();
         ret = (*memRead)(Buffer, Address, BytesLeft);
     }
     return ret;
@@ -216,6 +218,8 @@ bool AppMemoryUploadXModem( uint32_t (*getSize)(void), bool (*memWrite)(const vo
     uint32_t AvailBytes = (*getSize)();
     if(Address < AvailBytes) {
         uint32_t BytesLeft = MIN(ByteCount, AvailBytes - Address);
+        /* Commit reader writes still held in RAM first, they must not land on the uploaded data later */
+        ApplicationFlush();
         ret = (*memWrite)((const void *)Buffer, Address, BytesLeft);
     }
     return ret;
@@ -35,6 +35,8 @@
 #include <avr/pgmspace.h>
 #include "SPIFlash.h"
 #include "../Common.h"
+#include "../Perf.h"
+#include "../Codec/Codec.h"
 
 // Operating parameters for the different size flash chips that are supported
 static const flashGeometry_t AT45DBXX1X[] PROGMEM = {
@@ -57,12 +59,17 @@ Sector (s) > Block (b) > Page (p) > Byte (B)
 {9, 3, 3,10,256,32768,2048,4096,262144,2048,260096,32,64,8192,8388608}
 };
 
+FlashInfo_t FlashInfo;
+
 // Tells if Flash was correctly initialized
 static bool isFlashInit = false;
 
 /* Common helpers for SPI FLash commands
 ***************************************************************************************/
 
+/* The codec interrupt accesses the flash as well, so main loop operations hold
+ * it off from the first status poll until the chip is deselected */
+
 INLINE void OPStart(void) {
     FLASH_PORT.OUTCLR = FLASH_CS;
 }
@@ -82,6 +89,7 @@ INLINE uint8_t SPITransferByte(uint8_t Data)
 INLINE void SPIReadBlock(void* Buffer, uint16_t ByteCount)
 {
     uint8_t* ByteBuffer = (uint8_t*) Buffer;
+    PERF_ADD(SPIBytes, ByteCount);
     while(ByteCount--) {
         *ByteBuffer++ = SPITransferByte(FLASH_DUMMY_BYTE);
     }
@@ -90,6 +98,7 @@ INLINE void SPIReadBlock(void* Buffer, uint16_t ByteCount)
 INLINE void SPIWriteBlock(const void* Buffer, uint16_t ByteCount)
 {
     uint8_t* ByteBuffer = (uint8_t*) Buffer;
+    PERF_ADD(SPIBytes, ByteCount);
     while(ByteCount--) {
         SPITransferByte(*ByteBuffer++);
     }
@@ -106,7 +115,9 @@ INLINE uint8_t FlashReadStatusRegister(void)
 }
 
 INLINE void WaitForReadyFlash(void) {
-    while(!(FlashReadStatusRegister() & FLASH_STATUS_BUSY));
+    while(!(FlashReadStatusRegister() & FLASH_STATUS_BUSY)) {
+        PERF_COUNT(FlashBusyPolls);
+    }
 }
 
 INLINE bool checkAddrConsistency(uint32_t Address, uint32_t ByteCount) {
@@ -188,6 +199,7 @@ bool FlashInit(void) {
 bool FlashUnbufferedBytesRead(void* Buffer, uint32_t Address, uint32_t ByteCount) {
     bool ret = false;
     if( checkAddrConsistency(Address, ByteCount) ) {
+        CodecProcessLock();
         WaitForReadyFlash();
         OPStart();
         sendAddrOp(FLASH_OP_READ, Address);
@@ -195,6 +207,7 @@ bool FlashUnbufferedBytesRead(void* Buffer, uint32_t Address, uint32_t ByteCount
         SPITransferByte(FLASH_DUMMY_BYTE);
         SPIReadBlock(Buffer, ByteCount);
         OPStop();
+        CodecProcessUnlock();
         ret = true;
     }
     return ret;
@@ -212,6 +225,8 @@ bool FlashBufferedBytesWrite(const void* Buffer, uint32_t Address, uint32_t Byte
             PageNum = ((uint32_t)(Address / FlashInfo.geometry.bytesPerPage)) << FlashInfo.geometry.dummyBitsInPageAddr;
             Offset = (Address % FlashInfo.geometry.bytesPerPage);
             ByteRoll = (ByteCount >= FlashInfo.geometry.bytesPerPage) ? (FlashInfo.geometry.bytesPerPage - Offset) : (ByteCount);
+            // Page per page, as the interrupt could reuse the page buffer in between
+            CodecProcessLock();
             WaitForReadyFlash();
             OPStart();
             sendAddrOp(FLASH_OP_PAGE_TO_BUF1, PageNum);
@@ -221,6 +236,8 @@ bool FlashBufferedBytesWrite(const void* Buffer, uint32_t Address, uint32_t Byte
             sendAddrOp(FLASH_OP_BUF1_WRITE_PAGE, (PageNum | Offset));
             SPIWriteBlock(Buffer+Head, ByteRoll);
             OPStop();
+            CodecProcessUnlock();
+            PERF_COUNT(FlashPrograms);
             ByteCount -= ByteRoll;
             Address += ByteRoll;
             Head += ByteRoll;
@@ -236,10 +253,13 @@ bool FlashBufferedBytesWrite(const void* Buffer, uint32_t Address, uint32_t Byte
 bool FlashClearPage(uint16_t PageNum) {
     bool ret = false;
     if( isFlashInit && (PageNum < FlashInfo.geometry.pagesNumber) ) {
+        CodecProcessLock();
         WaitForReadyFlash();
         OPStart();
         sendAddrOp(FLASH_OP_PAGE_ERASE, ((uint32_t)PageNum) << FlashInfo.geometry.dummyBitsInPageAddr);
         OPStop();
+        CodecProcessUnlock();
+        PERF_COUNT(FlashErases);
         ret = true;
     }
     return ret;
@@ -248,10 +268,13 @@ bool FlashClearPage(uint16_t PageNum) {
 bool FlashClearBlock(uint16_t BlockNum) {
     bool ret = false;
     if( isFlashInit && (BlockNum < FlashInfo.geometry.blocksNumber) ) {
+        CodecProcessLock();
         WaitForReadyFlash();
         OPStart();
         sendAddrOp(FLASH_OP_BLOCK_ERASE, BlockNum << FlashInfo.geometry.dummyBitsInBlockAddr);
         OPStop();
+        CodecProcessUnlock();
+        PERF_COUNT(FlashErases);
         ret = true;
     }
     return ret;
@@ -262,6 +285,7 @@ bool FlashClearSector(uint16_t SectorNum) {
     if( isFlashInit && (SectorNum < FlashInfo.geometry.sectorsNumber) ) {
         bool retblock = true;
         uint32_t sector = FLASH_NO_OFFSET;
+        CodecProcessLock();
         WaitForReadyFlash();
         OPStart();
         if (SectorNum > FLASH_NO_OFFSET) {
@@ -273,6 +297,8 @@ bool FlashClearSector(uint16_t SectorNum) {
         }
         sendAddrOp(FLASH_OP_SECTOR_ERASE, sector);
         OPStop();
+        CodecProcessUnlock();
+        PERF_COUNT(FlashErases);
         ret = retblock;
     }
     return ret;
@@ -282,12 +308,15 @@ bool FlashClearAll(void) {
     bool ret = false;
     if (isFlashInit) {
         uint8_t opseq[] = { FLASH_SEQ_CHIP_ERASE };
+        CodecProcessLock();
         WaitForReadyFlash();
         OPStart();
         SPIWriteBlock(opseq, sizeof(opseq));
         OPStop();
+        PERF_COUNT(FlashErases);
         // Clearing might be long, so wait for memory to be ready before returning
         WaitForReadyFlash();
+        CodecProcessUnlock();
         ret = true;
     }
     return ret;
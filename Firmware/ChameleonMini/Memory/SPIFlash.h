@@ -81,6 +81,7 @@
 #define FLASH_BSIZE                 8 // Bits
 
 #define FLASH_SEQ_PAGE_SIZE_BINARY  0x3D, 0x2A, 0x80, 0xA6 // Binary page size (256 bytes)
+#define FLASH_BYTES_PER_PAGE_MIN    256 // Smallest binary page of the supported chips, the others are multiples of it
 #define FLASH_SEQ_CHIP_ERASE        0xC7, 0x94, 0x80, 0x9A // Erase entire chip
 
 #define FLASH_SECTOR_ADDR_0A        0x00
@@ -118,7 +119,7 @@ typedef struct {
     flashGeometry_t geometry;
 } FlashInfo_t;
 
-FlashInfo_t FlashInfo;
+extern FlashInfo_t FlashInfo;
 
 bool FlashInit(void);
 bool FlashUnbufferedBytesRead(void* Buffer, uint32_t Address, uint32_t ByteCount);
@@ -0,0 +1,18 @@
+/*
+ * Perf.c
+ *
+ *  The counters are bumped in place by the PERF_* macros, see Perf.h.
+ */
+
+#ifdef SUPPORT_PERF_COUNTERS
+
+#include <string.h>
+#include "Perf.h"
+
+PerfCountersType PerfCounters;
+
+void PerfReset(void) {
+    memset(&PerfCounters, 0, sizeof(PerfCounters));
+}
+
+#endif /* SUPPORT_PERF_COUNTERS */
@@ -0,0 +1,47 @@
+/*
+ * Perf.h
+ *
+ *  Event counters on the hot paths: SPI flash traffic, Crypto1 and CRC work, and
+ *  frames per configuration. Each costs one add where it is counted and compiles
+ *  away without SUPPORT_PERF_COUNTERS. Read with PERF?, cleared with PERF=RESET.
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#ifdef SUPPORT_PERF_COUNTERS
+
+#include "Common.h"
+#include "Settings.h"
+
+typedef struct {
+    uint32_t SPIBytes; /* Moved by SPIReadBlock/SPIWriteBlock, command bytes included */
+    uint32_t FlashBusyPolls; /* Status reads that found the flash still busy */
+    uint32_t FlashPrograms; /* Buffer to page programs */
+    uint32_t FlashErases; /* Page, block, sector and chip erases */
+    uint32_t Crypto1Clocks; /* LFSR steps */
+    uint32_t CRCBytes; /* Through the CRC engine, checks and appends */
+    uint32_t FrameDelayMisses; /* Answers that went out after the frame delay time */
+    uint32_t FrameDelayFallbacks; /* Provisional answers sent in place of late ones */
+    uint32_t FramesDropped; /* Reader frames longer than the codec or capture buffer */
+    uint16_t Frames[CONFIG_COUNT]; /* Reader frames, per active configuration. These wrap around */
+    uint16_t FramesBadCRC[CONFIG_COUNT];
+} PerfCountersType;
+
+extern PerfCountersType PerfCounters;
+
+void PerfReset(void);
+
+#define PERF_COUNT(Counter)         (PerfCounters.Counter++)
+#define PERF_ADD(Counter, Value)    (PerfCounters.Counter += (Value))
+#define PERF_COUNT_CONFIG(Counter)  (PerfCounters.Counter[GlobalSettings.ActiveSettingPtr->Configuration]++)
+
+#else
+
+#define PERF_COUNT(Counter)
+#define PERF_ADD(Counter, Value)
+#define PERF_COUNT_CONFIG(Counter)
+
+#endif /* SUPPORT_PERF_COUNTERS */
+
+#endif /* PERF_H_ */
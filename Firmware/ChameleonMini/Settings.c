@@ -9,6 +9,8 @@
 #include "Settings.h"
 #include <avr/eeprom.h>
 #include "Configuration.h"
+#include "Application/Application.h"
+#include "Codec/Codec.h"
 #include <string.h>
 #include "Memory/Memory.h"
 #include "Terminal/CommandLine.h"
@@ -56,11 +58,17 @@ void SettingsCycle(void) {
 
 bool SettingsSetActiveById(uint8_t Setting) {
     if ( (Setting >= SETTINGS_FIRST) && (Setting <= SETTINGS_LAST) ) {
+        /* The codec interrupt works on the active setting's memory */
+        CodecProcessLock();
+        /* Pending application data belongs to the setting we are leaving */
+        ApplicationFlush();
+
         GlobalSettings.ActiveSettingIdx = SETTING_TO_INDEX(Setting);
         GlobalSettings.ActiveSettingPtr = &GlobalSettings.Settings[GlobalSettings.ActiveSettingIdx];
 
         /* Settings have changed. Progress changes through system */
         ConfigurationInit();
+        CodecProcessUnlock();
         return true;
     } else {
         return false;
@@ -1,10 +1,17 @@
 #include "System.h"
 
+volatile uint16_t SystemTimestampHigh = 0;
+
 ISR(BADISR_vect)
 {
     while(1);
 }
 
+ISR(SYSTEM_TIMESTAMP_OVF_VECT)
+{
+    SystemTimestampHigh++;
+}
+
 void SystemInit(void)
 {
     if (RST.STATUS & RST_WDRF_bm) {
@@ -35,6 +42,13 @@ void SystemInit(void)
     TCE0.PER = F_CPU / 256 / SYSTEM_TICK_FREQ - 1;
     TCE0.CTRLA = TC_CLKSEL_DIV256_gc;
 
+    /* Free running timestamp counter, overflowing every ~16 ms. Its overflow interrupt
+     * is high level, as a codec task running at medium level or a masked low level
+     * could hold it off past the next overflow. It only takes a few cycles. */
+    SYSTEM_TIMESTAMP_TIMER.PER = 0xFFFF;
+    SYSTEM_TIMESTAMP_TIMER.INTCTRLA = TC_OVFINTLVL_HI_gc;
+    SYSTEM_TIMESTAMP_TIMER.CTRLA = SYSTEM_TIMESTAMP_CLKSEL;
+
     /* Enable RTC with roughly 1kHz clock */
     CLK.RTCCTRL = CLK_RTCSRC_ULP_gc | CLK_RTCEN_bm;
     RTC.CTRL = RTC_PRESCALER_DIV1_gc;
@@ -75,6 +75,18 @@ typedef uint16_t SystemRTCType;
 /* Use GPIORE and GPIORF as global tick register */
 #define SYSTEM_TICK_REGISTER	(*((volatile uint16_t*) &GPIORE))
 
+/* High resolution timebase for frame timestamps. TCD0 counts the peripheral clock
+ * and its overflow interrupt counts the upper 16 bits. Wraps after ~18 minutes. */
+#define SYSTEM_TIMESTAMP_TIMER      TCD0
+#define SYSTEM_TIMESTAMP_OVF_VECT   TCD0_OVF_vect
+#define SYSTEM_TIMESTAMP_CLKSEL     TC_CLKSEL_DIV8_gc
+#define SYSTEM_TIMESTAMP_FREQ       (F_CPU / 8)
+#define SYSTEM_TIMESTAMP_PER_US     (SYSTEM_TIMESTAMP_FREQ / 1000000)
+
+typedef uint32_t SystemTimestampType;
+
+extern volatile uint16_t SystemTimestampHigh;
+
 void SystemInit(void);
 void SystemReset(void);
 void SystemEnterBootloader(void);
@@ -105,4 +117,18 @@ INLINE uint16_t SystemGetSysTick(void) {
     return SYSTEM_TICK_REGISTER | RTC.CNT;
 }
 
+/* Safe to call with interrupts disabled, e.g. from the codec ISRs: an overflow
+ * that was not serviced yet is accounted for by its pending flag. */
+INLINE SystemTimestampType SystemGetTimestamp(void) {
+    uint8_t Sreg = SREG;
+    cli();
+    uint16_t Low = SYSTEM_TIMESTAMP_TIMER.CNT;
+    uint16_t High = SystemTimestampHigh;
+    if ( (SYSTEM_TIMESTAMP_TIMER.INTFLAGS & TC0_OVFIF_bm) && (Low < 0x8000) ) {
+        High++;
+    }
+    SREG = Sreg;
+    return ((SystemTimestampType) High << 16) | Low;
+}
+
 #endif /* SYSTEM_H */
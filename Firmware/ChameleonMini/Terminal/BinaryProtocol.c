@@ -0,0 +1,311 @@
+/*
+ * BinaryProtocol.c
+ *
+ *  Requests are collected into TerminalBuffer and dispatched through a table indexed
+ *  by the opcode. Handlers take the raw payload and leave their answer in its place.
+ */
+
+#ifdef SUPPORT_BINARY_PROTOCOL
+
+#include <string.h>
+#include <util/crc16.h>
+#include "BinaryProtocol.h"
+#include "Terminal.h"
+#include "../Settings.h"
+#include "../Configuration.h"
+#include "../ChameleonMini.h"
+#include "../Memory/Memory.h"
+#include "../Application/Application.h"
+
+#define BINARY_CRC_INIT             0
+#define BINARY_MEM_HEADER_LEN       4 /* Address in front of the memory data */
+#define BINARY_MEM_READ_LEN         6 /* Address and length */
+
+typedef uint8_t (*BinaryOpFuncType) (uint8_t* Buffer, uint16_t* Length);
+
+static const uint8_t PROGMEM BinaryMagic[BINARY_MAGIC_LEN] = BINARY_MAGIC;
+
+static enum {
+    BINARY_STATE_OFF,
+    BINARY_STATE_HEADER,
+    BINARY_STATE_PAYLOAD,
+    BINARY_STATE_CRC
+} State = BINARY_STATE_OFF;
+
+static uint8_t MagicIdx = 0;
+static uint8_t Header[BINARY_REQUEST_HEADER_LEN];
+static uint8_t HeaderIdx;
+static uint16_t Length;
+static uint16_t PayloadIdx;
+static uint16_t Crc;
+static uint16_t ReceivedCrc;
+static uint8_t CrcIdx;
+static uint8_t FrameTimeout;
+static bool ExitRequested;
+
+INLINE uint32_t BinaryGetUint32(const uint8_t* Buffer) {
+    return Buffer[0] | ((uint32_t) Buffer[1] << 8) | ((uint32_t) Buffer[2] << 16) | ((uint32_t) Buffer[3] << 24);
+}
+
+INLINE void BinaryPutUint32(uint8_t* Buffer, uint32_t Value) {
+    Buffer[0] = (uint8_t) Value;
+    Buffer[1] = (uint8_t) (Value >> 8);
+    Buffer[2] = (uint8_t) (Value >> 16);
+    Buffer[3] = (uint8_t) (Value >> 24);
+}
+
+static uint16_t CalcCrc(uint16_t Crc, const uint8_t* Buffer, uint16_t ByteCount) {
+    while (ByteCount--) {
+        Crc = _crc_xmodem_update(Crc, *Buffer++);
+    }
+    return Crc;
+}
+
+static uint8_t BinaryMemRead(uint8_t* Buffer, uint16_t* Length, bool (*memRead)(void*, uint32_t, uint32_t), uint32_t MemSize) {
+    uint32_t Address;
+    uint16_t ByteCount;
+
+    if (*Length != BINARY_MEM_READ_LEN) {
+        return BINARY_STATUS_INVALID_PARAM;
+    }
+    Address = BinaryGetUint32(Buffer);
+    ByteCount = Buffer[4] | ((uint16_t) Buffer[5] << 8);
+    if ( (ByteCount > BINARY_PAYLOAD_MAX) || (Address > MemSize) || (ByteCount > MemSize - Address) ) {
+        return BINARY_STATUS_INVALID_PARAM;
+    }
+    if (!memRead(Buffer, Address, ByteCount)) {
+        return BINARY_STATUS_FAILED;
+    }
+    *Length = ByteCount;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryMemWrite(uint8_t* Buffer, uint16_t* Length, bool (*memWrite)(const void*, uint32_t, uint32_t), uint32_t MemSize) {
+    uint32_t Address;
+    uint16_t ByteCount;
+
+    if (*Length < BINARY_MEM_HEADER_LEN) {
+        return BINARY_STATUS_INVALID_PARAM;
+    }
+    Address = BinaryGetUint32(Buffer);
+    ByteCount = *Length - BINARY_MEM_HEADER_LEN;
+    *Length = 0;
+    if ( (Address > MemSize) || (ByteCount > MemSize - Address) ) {
+        return BINARY_STATUS_INVALID_PARAM;
+    }
+    if (!memWrite(&Buffer[BINARY_MEM_HEADER_LEN], Address, ByteCount)) {
+        return BINARY_STATUS_FAILED;
+    }
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpPing(uint8_t* Buffer, uint16_t* Length) {
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpExit(uint8_t* Buffer, uint16_t* Length) {
+    *Length = 0;
+    ExitRequested = true;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpVersion(uint8_t* Buffer, uint16_t* Length) {
+    CommandGetVersion((char*) Buffer);
+    *Length = strlen((char*) Buffer);
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpGetConfig(uint8_t* Buffer, uint16_t* Length) {
+    Buffer[0] = GlobalSettings.ActiveSettingPtr->Configuration;
+    *Length = 1;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpSetConfig(uint8_t* Buffer, uint16_t* Length) {
+    if ( (*Length != 1) || (Buffer[0] >= CONFIG_COUNT) ) {
+        return BINARY_STATUS_INVALID_PARAM;
+    }
+    ConfigurationSetById(Buffer[0]);
+    SettingsSave();
+    *Length = 0;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpGetUid(uint8_t* Buffer, uint16_t* Length) {
+    ApplicationGetUid(Buffer);
+    *Length = ActiveConfiguration.UidSize;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpSetUid(uint8_t* Buffer, uint16_t* Length) {
+    if (*Length != ActiveConfiguration.UidSize) {
+        return BINARY_STATUS_INVALID_PARAM;
+    }
+    ApplicationSetUid(Buffer);
+    *Length = 0;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpGetSetting(uint8_t* Buffer, uint16_t* Length) {
+    Buffer[0] = SettingsGetActiveById();
+    *Length = 1;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpSetSetting(uint8_t* Buffer, uint16_t* Length) {
+    if ( (*Length != 1) || !SettingsSetActiveById(Buffer[0]) ) {
+        return BINARY_STATUS_INVALID_PARAM;
+    }
+    SettingsSave();
+    *Length = 0;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpGetMemSize(uint8_t* Buffer, uint16_t* Length) {
+    BinaryPutUint32(&Buffer[0], AppCardMemorySize());
+    BinaryPutUint32(&Buffer[4], AppWorkingMemorySize());
+    *Length = 8;
+    return BINARY_STATUS_OK;
+}
+
+static uint8_t BinaryOpReadMem(uint8_t* Buffer, uint16_t* Length) {
+    return BinaryMemRead(Buffer, Length, &AppCardMemoryRead, AppCardMemorySize());
+}
+
+static uint8_t BinaryOpWriteMem(uint8_t* Buffer, uint16_t* Length) {
+    return BinaryMemWrite(Buffer, Length, &AppCardMemoryWrite, AppCardMemorySize());
+}
+
+static uint8_t BinaryOpReadWorkMem(uint8_t* Buffer, uint16_t* Length) {
+    return BinaryMemRead(Buffer, Length, &AppWorkingMemoryRead, AppWorkingMemorySize());
+}
+
+static uint8_t BinaryOpWriteWorkMem(uint8_t* Buffer, uint16_t* Length) {
+    return BinaryMemWrite(Buffer, Length, &AppWorkingMemoryWrite, AppWorkingMemorySize());
+}
+
+static const BinaryOpFuncType PROGMEM BinaryOpTable[BINARY_OP_COUNT] = {
+    [BINARY_OP_PING]            = BinaryOpPing,
+    [BINARY_OP_EXIT]            = BinaryOpExit,
+    [BINARY_OP_VERSION]         = BinaryOpVersion,
+    [BINARY_OP_GET_CONFIG]      = BinaryOpGetConfig,
+    [BINARY_OP_SET_CONFIG]      = BinaryOpSetConfig,
+    [BINARY_OP_GET_UID]         = BinaryOpGetUid,
+    [BINARY_OP_SET_UID]         = BinaryOpSetUid,
+    [BINARY_OP_GET_SETTING]     = BinaryOpGetSetting,
+    [BINARY_OP_SET_SETTING]     = BinaryOpSetSetting,
+    [BINARY_OP_GET_MEMSIZE]     = BinaryOpGetMemSize,
+    [BINARY_OP_READ_MEM]        = BinaryOpReadMem,
+    [BINARY_OP_WRITE_MEM]       = BinaryOpWriteMem,
+    [BINARY_OP_READ_WORKMEM]    = BinaryOpReadWorkMem,
+    [BINARY_OP_WRITE_WORKMEM]   = BinaryOpWriteWorkMem,
+};
+
+static void SendResponse(uint8_t Status, uint16_t PayloadLength) {
+    uint8_t ResponseHeader[] = { Header[0], Header[1], Status, (uint8_t) PayloadLength, (uint8_t) (PayloadLength >> 8) };
+    uint16_t ResponseCrc = CalcCrc(BINARY_CRC_INIT, ResponseHeader, sizeof(ResponseHeader));
+
+    ResponseCrc = CalcCrc(ResponseCrc, TerminalBuffer, PayloadLength);
+    TerminalSendBlock(ResponseHeader, sizeof(ResponseHeader));
+    TerminalSendBlock(TerminalBuffer, PayloadLength);
+    TerminalSendByte((uint8_t) ResponseCrc);
+    TerminalSendByte((uint8_t) (ResponseCrc >> 8));
+}
+
+static void ProcessRequest(void) {
+    uint8_t Opcode = Header[0];
+    uint16_t PayloadLength = Length;
+    uint8_t Status;
+
+    if (ReceivedCrc != Crc) {
+        Status = BINARY_STATUS_CRC_ERROR;
+        PayloadLength = 0;
+    } else if (Length > BINARY_PAYLOAD_MAX) {
+        Status = BINARY_STATUS_INVALID_PARAM;
+        PayloadLength = 0;
+    } else {
+        BinaryOpFuncType OpFunc = (Opcode < BINARY_OP_COUNT) ? pgm_read_ptr(&BinaryOpTable[Opcode]) : NULL;
+
+        if (OpFunc != NULL) {
+            /* Requests may access the application memory, so commit what is only held in RAM */
+            ApplicationFlush();
+            Status = OpFunc(TerminalBuffer, &PayloadLength);
+        } else {
+            Status = BINARY_STATUS_UNKNOWN_OP;
+        }
+        if (Status != BINARY_STATUS_OK) {
+            PayloadLength = 0;
+        }
+    }
+
+    SendResponse(Status, PayloadLength);
+}
+
+bool BinaryProtocolProcessByte(uint8_t Byte) {
+    switch (State) {
+    case BINARY_STATE_OFF:
+        /* Watch for the magic, the byte is left to the command line anyway */
+        if (Byte == pgm_read_byte(&BinaryMagic[MagicIdx])) {
+            if (++MagicIdx == BINARY_MAGIC_LEN) {
+                MagicIdx = 0;
+                HeaderIdx = 0;
+                ExitRequested = false;
+                State = BINARY_STATE_HEADER;
+            }
+        } else {
+            MagicIdx = (Byte == pgm_read_byte(&BinaryMagic[0])) ? 1 : 0;
+        }
+        return false;
+
+    case BINARY_STATE_HEADER:
+        Header[HeaderIdx++] = Byte;
+        if (HeaderIdx == BINARY_REQUEST_HEADER_LEN) {
+            Length = Header[2] | ((uint16_t) Header[3] << 8);
+            Crc = CalcCrc(BINARY_CRC_INIT, Header, BINARY_REQUEST_HEADER_LEN);
+            PayloadIdx = 0;
+            CrcIdx = 0;
+            State = (Length > 0) ? BINARY_STATE_PAYLOAD : BINARY_STATE_CRC;
+        }
+        break;
+
+    case BINARY_STATE_PAYLOAD:
+        /* Oversized payloads are still consumed to stay in sync with the host */
+        if (PayloadIdx < BINARY_PAYLOAD_MAX) {
+            TerminalBuffer[PayloadIdx] = Byte;
+        }
+        Crc = _crc_xmodem_update(Crc, Byte);
+        if (++PayloadIdx == Length) {
+            State = BINARY_STATE_CRC;
+        }
+        break;
+
+    case BINARY_STATE_CRC:
+        if (CrcIdx++ == 0) {
+            ReceivedCrc = Byte;
+        } else {
+            ReceivedCrc |= (uint16_t) Byte << 8;
+            ProcessRequest();
+            HeaderIdx = 0;
+            State = ExitRequested ? BINARY_STATE_OFF : BINARY_STATE_HEADER;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    FrameTimeout = BINARY_FRAME_TIMEOUT;
+    return true;
+}
+
+void BinaryProtocolTick(void) {
+    if ( (State != BINARY_STATE_OFF) && ((State != BINARY_STATE_HEADER) || (HeaderIdx > 0)) ) {
+        if (--FrameTimeout == 0) {
+            /* Host stopped in the middle of a request, resynchronize on the next one */
+            HeaderIdx = 0;
+            State = BINARY_STATE_HEADER;
+        }
+    }
+}
+
+#endif /* SUPPORT_BINARY_PROTOCOL */
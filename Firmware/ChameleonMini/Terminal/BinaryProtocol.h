@@ -0,0 +1,54 @@
+/*
+ * BinaryProtocol.h
+ *
+ *  Binary framed alternative to the text command line for host automation.
+ *  Entered by sending BINARY_MAGIC on the terminal, left with BINARY_OP_EXIT.
+ */
+
+#ifdef SUPPORT_BINARY_PROTOCOL
+
+#ifndef BINARY_PROTOCOL_H_
+#define BINARY_PROTOCOL_H_
+
+#include "Terminal.h"
+
+/* None of these bytes is taken by the text command line, so it stays untouched */
+#define BINARY_MAGIC                { 0xFE, 0x01, 0xB1, 0x9C }
+#define BINARY_MAGIC_LEN            4
+
+/* Request:  opcode (1) | sequence (1) | length (2 LE) | payload | CRC (2 LE)
+ * Response: opcode (1) | sequence (1) | status (1) | length (2 LE) | payload | CRC (2 LE)
+ * The CRC is the XModem CRC-16 over everything before it. Requests may be sent
+ * back to back, they are answered in order and the sequence byte is echoed. */
+#define BINARY_REQUEST_HEADER_LEN   4
+#define BINARY_PAYLOAD_MAX          TERMINAL_BUFFER_SIZE
+#define BINARY_FRAME_TIMEOUT        5 /* x 100ms without a byte drops a partial request */
+
+#define BINARY_OP_PING              0x00 /* Payload is echoed */
+#define BINARY_OP_EXIT              0x01 /* Back to the text command line after the answer */
+#define BINARY_OP_VERSION           0x02 /* Answer: version string */
+#define BINARY_OP_GET_CONFIG        0x10 /* Answer: configuration id (1) */
+#define BINARY_OP_SET_CONFIG        0x11 /* Configuration id (1) */
+#define BINARY_OP_GET_UID           0x12 /* Answer: UID bytes */
+#define BINARY_OP_SET_UID           0x13 /* UID bytes, exactly the UID size of the configuration */
+#define BINARY_OP_GET_SETTING       0x14 /* Answer: setting number (1) */
+#define BINARY_OP_SET_SETTING       0x15 /* Setting number (1) */
+#define BINARY_OP_GET_MEMSIZE       0x16 /* Answer: card memory size (4 LE), working memory size (4 LE) */
+#define BINARY_OP_READ_MEM          0x20 /* Address (4 LE), length (2 LE). Answer: the card memory bytes */
+#define BINARY_OP_WRITE_MEM         0x21 /* Address (4 LE), bytes to write to the card memory */
+#define BINARY_OP_READ_WORKMEM      0x22 /* As BINARY_OP_READ_MEM, for the working memory */
+#define BINARY_OP_WRITE_WORKMEM     0x23 /* As BINARY_OP_WRITE_MEM, for the working memory */
+#define BINARY_OP_COUNT             0x24
+
+#define BINARY_STATUS_OK            0x00
+#define BINARY_STATUS_CRC_ERROR     0x01 /* Request dropped, nothing was executed */
+#define BINARY_STATUS_UNKNOWN_OP    0x02
+#define BINARY_STATUS_INVALID_PARAM 0x03
+#define BINARY_STATUS_FAILED        0x04
+
+bool BinaryProtocolProcessByte(uint8_t Byte);
+void BinaryProtocolTick(void);
+
+#endif /* BINARY_PROTOCOL_H_ */
+
+#endif /* SUPPORT_BINARY_PROTOCOL */
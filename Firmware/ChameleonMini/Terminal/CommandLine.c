@@ -5,9 +5,11 @@
  *      Author: skuser
  */
 
+#include <string.h>
 #include "CommandLine.h"
 #include "../Settings.h"
 #include "../System.h"
+#include "../Application/Application.h"
 
 #define CHAR_GET_MODE   '?'     /* <Command>? */
 #define CHAR_SET_MODE   '='     /* <Command>=<Param> */
@@ -18,11 +20,18 @@
   ((c) == CHAR_EXEC_MODE) || ((c) == CHAR_GET_MODE) || ((c) == CHAR_SET_MODE) || ((c) == CHAR_EXEC_MODE_PARAM) \
 )
 
+#ifdef SUPPORT_COMMAND_QUEUE
+#define CHAR_TAG        '#'     /* #<Tag> <Command>, the status line is prefixed with #<Tag> */
+#define IS_TAG_CHARACTER(c) ((c) == CHAR_TAG)
+#else
+#define IS_TAG_CHARACTER(c) (false)
+#endif
+
 #define IS_CHARACTER(c) ( \
   ( ((c) >= 'A') && ((c) <= 'Z') ) || \
   ( ((c) >= 'a') && ((c) <= 'z') ) || \
   ( ((c) >= '0') && ((c) <= '9') ) || \
-  ( ((c) == '_') ) || \
+  ( ((c) == '_') ) || IS_TAG_CHARACTER(c) || \
   ( ((c) == CHAR_GET_MODE) || ((c) == CHAR_SET_MODE) || ((c) == CHAR_EXEC_MODE_PARAM) ) \
 )
 
@@ -39,56 +48,68 @@
 /* Include all command functions */
 #include "Commands.h"
 
+/* Sorted by name in strcmp order, commands are looked up by binary search.
+ * COMMAND_LIST_END stays the last entry and is not part of the search.
+ * The check-tables step of the Makefile fails the build otherwise. */
 const PROGMEM CommandEntryType CommandTable[] = {
   {
-    .Command    = COMMAND_VERSION,
-    .ExecFunc   = NO_FUNCTION,
+      .Command    = COMMAND_ATQA,
+      .ExecFunc   = NO_FUNCTION,
+      .ExecParamFunc = NO_FUNCTION,
+      .SetFunc    = CommandSetAtqa,
+      .GetFunc    = CommandGetAtqa
+  },
+/*
+  {
+    .Command    = COMMAND_AUTOCALIBRATE,
+    .ExecFunc   = CommandExecAutocalibrate,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
-    .GetFunc    = CommandGetVersion,
+    .GetFunc    = NO_FUNCTION
   },
+*/
   {
-    .Command    = COMMAND_CONFIG,
-    .ExecFunc   = CommandExecConfig,
+    .Command    = COMMAND_BUTTON,
+    .ExecFunc   = CommandExecButton,
     .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = CommandSetConfig,
-    .GetFunc    = CommandGetConfig
+    .SetFunc    = CommandSetButton,
+    .GetFunc    = CommandGetButton
   },
   {
-    .Command    = COMMAND_UID,
-    .ExecFunc   = NO_FUNCTION,
+    .Command    = COMMAND_BUTTON_LONG,
+    .ExecFunc   = CommandExecButtonLong,
     .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = CommandSetUid,
-    .GetFunc    = CommandGetUid
+    .SetFunc    = CommandSetButtonLong,
+    .GetFunc    = CommandGetButtonLong
   },
   {
-      .Command    = COMMAND_ATQA,
-      .ExecFunc   = NO_FUNCTION,
-      .ExecParamFunc = NO_FUNCTION,
-      .SetFunc    = CommandSetAtqa,
-      .GetFunc    = CommandGetAtqa
+    .Command    = COMMAND_CLEAR,
+    .ExecFunc   = CommandExecClear,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = NO_FUNCTION
   },
   {
-      .Command    = COMMAND_SAK,
-      .ExecFunc   = NO_FUNCTION,
-      .ExecParamFunc = NO_FUNCTION,
-      .SetFunc    = CommandSetSak,
-      .GetFunc    = CommandGetSak
+      .Command    = COMMAND_CLEARALL,
+      .ExecFunc   = CommandExecClearAll,
+      .SetFunc    = NO_FUNCTION,
+      .GetFunc    = NO_FUNCTION,
   },
   {
-    .Command    = COMMAND_READONLY,
-    .ExecFunc   = NO_FUNCTION,
+    .Command    = COMMAND_CONFIG,
+    .ExecFunc   = CommandExecConfig,
     .ExecParamFunc = NO_FUNCTION,
-    .GetFunc    = CommandGetReadOnly,
-    .SetFunc    = CommandSetReadOnly
+    .SetFunc    = CommandSetConfig,
+    .GetFunc    = CommandGetConfig
   },
+#ifdef CONFIG_MF_CLASSIC_DETECTION_SUPPORT
   {
-    .Command    = COMMAND_UPLOAD,
-    .ExecFunc   = CommandExecUpload,
-    .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
+      .Command    = COMMAND_DETECTION,
+      .ExecFunc   = NO_FUNCTION,
+      .SetFunc    = NO_FUNCTION,
+      .GetFunc    = CommandGetDetection,
   },
+#endif
   {
     .Command    = COMMAND_DOWNLOAD,
     .ExecFunc   = CommandExecDownload,
@@ -96,72 +117,85 @@ const PROGMEM CommandEntryType CommandTable[] = {
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = NO_FUNCTION
   },
+/*
   {
-    .Command    = COMMAND_RESET,
-    .ExecFunc   = CommandExecReset,
+    .Command    = COMMAND_DUMP_MFU,
+    .ExecFunc   = CommandExecDumpMFU,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = NO_FUNCTION
   },
-#ifdef SUPPORT_FIRMWARE_UPGRADE
   {
-    .Command    = COMMAND_UPGRADE,
-    .ExecFunc   = CommandExecUpgrade,
+    .Command    = COMMAND_FIELD,
+    .ExecFunc   = NO_FUNCTION,
     .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
+    .SetFunc    = CommandSetField,
+    .GetFunc    = CommandGetField
   },
-#endif
   {
-    .Command    = COMMAND_MEMSIZE,
-    .ExecFunc   = NO_FUNCTION,
+    .Command    = COMMAND_GETUID,
+    .ExecFunc   = CommandExecGetUid,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
-    .GetFunc    = CommandGetMemSize
+    .GetFunc    = NO_FUNCTION
   },
+*/
   {
-    .Command    = COMMAND_WORKMEM,
-    .ExecFunc   = CommandExecWorkingMem,
+    .Command    = COMMAND_HELP,
+    .ExecFunc   = CommandExecHelp,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
-    .GetFunc    = CommandGetWorkingMem
+    .GetFunc    = NO_FUNCTION
   },
+/*
   {
-    .Command    = COMMAND_WORKMEMUPLOAD,
-    .ExecFunc   = CommandExecWorkingMemUpload,
+    .Command    = COMMAND_IDENTIFY_CARD,
+    .ExecFunc   = CommandExecIdentifyCard,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = NO_FUNCTION
   },
+*/
+#ifdef SUPPORT_LATENCY_STATS
   {
-    .Command    = COMMAND_WORKMEMDOWNLOAD,
-    .ExecFunc   = CommandExecWorkingMemDownload,
+      .Command    = COMMAND_LATENCY,
+      .ExecFunc   = NO_FUNCTION,
+      .SetFunc    = CommandSetLatency,
+      .GetFunc    = CommandGetLatency,
+  },
+#endif
+/*
+  {
+    .Command    = COMMAND_LOGCLEAR,
+    .ExecFunc   = CommandExecLogClear,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = NO_FUNCTION
   },
   {
-    .Command    = COMMAND_UIDSIZE,
-    .ExecFunc   = NO_FUNCTION,
+    .Command    = COMMAND_LOGDOWNLOAD,
+    .ExecFunc   = CommandExecLogDownload,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
-    .GetFunc    = CommandGetUidSize
+    .GetFunc    = NO_FUNCTION
   },
+*/
+#ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
   {
-    .Command    = COMMAND_BUTTON,
-    .ExecFunc   = CommandExecButton,
-    .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = CommandSetButton,
-    .GetFunc    = CommandGetButton
+      .Command    = COMMAND_LOGFILTER,
+      .ExecFunc   = NO_FUNCTION,
+      .SetFunc    = CommandSetLogFilter,
+      .GetFunc    = CommandGetLogFilter,
   },
+#endif
+/*
   {
-    .Command    = COMMAND_BUTTON_LONG,
-    .ExecFunc   = CommandExecButtonLong,
+    .Command    = COMMAND_LOGMEM,
+    .ExecFunc   = NO_FUNCTION,
     .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = CommandSetButtonLong,
-    .GetFunc    = CommandGetButtonLong
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = CommandGetLogMem
   },
-  /*
   {
     .Command    = COMMAND_LOGMODE,
     .ExecFunc   = NO_FUNCTION,
@@ -169,57 +203,63 @@ const PROGMEM CommandEntryType CommandTable[] = {
     .SetFunc    = CommandSetLogMode,
     .GetFunc    = CommandGetLogMode
   },
+*/
+#ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
   {
-    .Command    = COMMAND_LOGMEM,
-    .ExecFunc   = NO_FUNCTION,
-    .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = CommandGetLogMem
+      .Command    = COMMAND_LOGSYNC,
+      .ExecFunc   = NO_FUNCTION,
+      .SetFunc    = CommandSetLogSync,
+      .GetFunc    = NO_FUNCTION,
   },
+#endif
+#ifdef CONFIG_DEBUG_MEMORYINFO_COMMAND
   {
-    .Command    = COMMAND_LOGDOWNLOAD,
-    .ExecFunc   = CommandExecLogDownload,
-    .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
+      .Command    = COMMAND_MEMORYINFO,
+      .ExecFunc   = CommandExecMemoryInfo,
+      .SetFunc    = NO_FUNCTION,
+      .GetFunc    = NO_FUNCTION,
   },
+#endif
+#ifdef CONFIG_DEBUG_MEMORYTEST_COMMAND
   {
-    .Command    = COMMAND_STORELOG,
-    .ExecFunc   = CommandExecStoreLog,
-    .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
+      .Command    = COMMAND_MEMORYTEST,
+      .ExecFunc   = CommandExecMemoryTest,
+      .SetFunc    = NO_FUNCTION,
+      .GetFunc    = NO_FUNCTION,
   },
+#endif
   {
-    .Command    = COMMAND_LOGCLEAR,
-    .ExecFunc   = CommandExecLogClear,
+    .Command    = COMMAND_MEMSIZE,
+    .ExecFunc   = NO_FUNCTION,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
+    .GetFunc    = CommandGetMemSize
   },
-*/
+#ifdef SUPPORT_PERF_COUNTERS
   {
-    .Command    = COMMAND_SETTING,
-    .ExecFunc   = NO_FUNCTION,
-    .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = CommandSetSetting,
-    .GetFunc    = CommandGetSetting
+      .Command    = COMMAND_PERF,
+      .ExecFunc   = NO_FUNCTION,
+      .SetFunc    = CommandSetPerf,
+      .GetFunc    = CommandGetPerf,
   },
+#endif
+#ifdef CONFIG_MF_ULTRALIGHT_SUPPORT
   {
-    .Command    = COMMAND_CLEAR,
-    .ExecFunc   = CommandExecClear,
+    .Command    = COMMAND_PWD,
+    .ExecFunc   = NO_FUNCTION,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
+    .GetFunc    = CommandGetUltralightPassword
   },
-/*
+#endif
   {
-    .Command    = COMMAND_STORE,
-    .ExecFunc   = CommandExecStore,
+    .Command    = COMMAND_READONLY,
+    .ExecFunc   = NO_FUNCTION,
     .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
+    .GetFunc    = CommandGetReadOnly,
+    .SetFunc    = CommandSetReadOnly
   },
+/*
   {
     .Command    = COMMAND_RECALL,
     .ExecFunc   = CommandExecRecall,
@@ -229,8 +269,8 @@ const PROGMEM CommandEntryType CommandTable[] = {
   },
 */
   {
-    .Command    = COMMAND_HELP,
-    .ExecFunc   = CommandExecHelp,
+    .Command    = COMMAND_RESET,
+    .ExecFunc   = CommandExecReset,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = NO_FUNCTION
@@ -242,22 +282,20 @@ const PROGMEM CommandEntryType CommandTable[] = {
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = CommandGetRssi
   },
-#ifdef CONFIG_MF_ULTRALIGHT_SUPPORT
   {
-    .Command    = COMMAND_PWD,
-    .ExecFunc   = NO_FUNCTION,
-    .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = CommandGetUltralightPassword
+      .Command    = COMMAND_SAK,
+      .ExecFunc   = NO_FUNCTION,
+      .ExecParamFunc = NO_FUNCTION,
+      .SetFunc    = CommandSetSak,
+      .GetFunc    = CommandGetSak
   },
-#endif
 /*
   {
-    .Command    = COMMAND_SYSTICK,
+    .Command    = COMMAND_SEND,
     .ExecFunc   = NO_FUNCTION,
-    .ExecParamFunc = NO_FUNCTION,
+    .ExecParamFunc = CommandExecParamSend,
     .SetFunc    = NO_FUNCTION,
-    .GetFunc    = CommandGetSysTick
+    .GetFunc    = NO_FUNCTION
   },
   {
     .Command    = COMMAND_SEND_RAW,
@@ -266,40 +304,35 @@ const PROGMEM CommandEntryType CommandTable[] = {
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = NO_FUNCTION
   },
+*/
   {
-    .Command    = COMMAND_SEND,
+    .Command    = COMMAND_SETTING,
     .ExecFunc   = NO_FUNCTION,
-    .ExecParamFunc = CommandExecParamSend,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
-  },
-  {
-    .Command    = COMMAND_GETUID,
-    .ExecFunc   = CommandExecGetUid,
     .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
+    .SetFunc    = CommandSetSetting,
+    .GetFunc    = CommandGetSetting
   },
+/*
   {
-    .Command    = COMMAND_DUMP_MFU,
-    .ExecFunc   = CommandExecDumpMFU,
+    .Command    = COMMAND_STORE,
+    .ExecFunc   = CommandExecStore,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = NO_FUNCTION
   },
   {
-    .Command    = COMMAND_IDENTIFY_CARD,
-    .ExecFunc   = CommandExecIdentifyCard,
+    .Command    = COMMAND_STORELOG,
+    .ExecFunc   = CommandExecStoreLog,
     .ExecParamFunc = NO_FUNCTION,
     .SetFunc    = NO_FUNCTION,
     .GetFunc    = NO_FUNCTION
   },
   {
-    .Command    = COMMAND_TIMEOUT,
+    .Command    = COMMAND_SYSTICK,
     .ExecFunc   = NO_FUNCTION,
     .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = CommandSetTimeout,
-    .GetFunc    = CommandGetTimeout
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = CommandGetSysTick
   },
   {
     .Command    = COMMAND_THRESHOLD,
@@ -309,28 +342,28 @@ const PROGMEM CommandEntryType CommandTable[] = {
     .GetFunc    = CommandGetThreshold
   },
   {
-    .Command    = COMMAND_AUTOCALIBRATE,
-    .ExecFunc   = CommandExecAutocalibrate,
-    .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = NO_FUNCTION,
-    .GetFunc    = NO_FUNCTION
-  },
-  {
-    .Command    = COMMAND_FIELD,
+    .Command    = COMMAND_TIMEOUT,
     .ExecFunc   = NO_FUNCTION,
     .ExecParamFunc = NO_FUNCTION,
-    .SetFunc    = CommandSetField,
-    .GetFunc    = CommandGetField
+    .SetFunc    = CommandSetTimeout,
+    .GetFunc    = CommandGetTimeout
   },
 */
-#ifdef CONFIG_MF_CLASSIC_DETECTION_SUPPORT
+#ifdef SUPPORT_LIVE_TRACE
   {
-      .Command    = COMMAND_DETECTION,
+      .Command    = COMMAND_TRACE,
       .ExecFunc   = NO_FUNCTION,
-      .SetFunc    = NO_FUNCTION,
-      .GetFunc    = CommandGetDetection,
+      .SetFunc    = CommandSetTrace,
+      .GetFunc    = CommandGetTrace,
   },
 #endif
+  {
+    .Command    = COMMAND_UID,
+    .ExecFunc   = NO_FUNCTION,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = CommandSetUid,
+    .GetFunc    = CommandGetUid
+  },
 #ifdef SUPPORT_MF_CLASSIC_MAGIC_MODE
   {
       .Command    = COMMAND_UIDMOD,
@@ -340,27 +373,56 @@ const PROGMEM CommandEntryType CommandTable[] = {
   },
 #endif
   {
-      .Command    = COMMAND_CLEARALL,
-      .ExecFunc   = CommandExecClearAll,
-      .SetFunc    = NO_FUNCTION,
-      .GetFunc    = NO_FUNCTION,
+    .Command    = COMMAND_UIDSIZE,
+    .ExecFunc   = NO_FUNCTION,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = CommandGetUidSize
   },
-#ifdef CONFIG_DEBUG_MEMORYINFO_COMMAND
+#ifdef SUPPORT_FIRMWARE_UPGRADE
   {
-      .Command    = COMMAND_MEMORYINFO,
-      .ExecFunc   = CommandExecMemoryInfo,
-      .SetFunc    = NO_FUNCTION,
-      .GetFunc    = NO_FUNCTION,
+    .Command    = COMMAND_UPGRADE,
+    .ExecFunc   = CommandExecUpgrade,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = NO_FUNCTION
   },
 #endif
-#ifdef CONFIG_DEBUG_MEMORYTEST_COMMAND
   {
-      .Command    = COMMAND_MEMORYTEST,
-      .ExecFunc   = CommandExecMemoryTest,
-      .SetFunc    = NO_FUNCTION,
-      .GetFunc    = NO_FUNCTION,
+    .Command    = COMMAND_UPLOAD,
+    .ExecFunc   = CommandExecUpload,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = NO_FUNCTION
+  },
+  {
+    .Command    = COMMAND_VERSION,
+    .ExecFunc   = NO_FUNCTION,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = CommandGetVersion,
+  },
+  {
+    .Command    = COMMAND_WORKMEM,
+    .ExecFunc   = CommandExecWorkingMem,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = CommandGetWorkingMem
+  },
+  {
+    .Command    = COMMAND_WORKMEMDOWNLOAD,
+    .ExecFunc   = CommandExecWorkingMemDownload,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = NO_FUNCTION
+  },
+  {
+    .Command    = COMMAND_WORKMEMUPLOAD,
+    .ExecFunc   = CommandExecWorkingMemUpload,
+    .ExecParamFunc = NO_FUNCTION,
+    .SetFunc    = NO_FUNCTION,
+    .GetFunc    = NO_FUNCTION
   },
-#endif
   { /* This has to be last element */
     .Command    = COMMAND_LIST_END,
     .ExecFunc   = NO_FUNCTION,
@@ -377,6 +439,7 @@ typedef struct {
     CommandStatusMessageType Message;
 } CommandStatusType;
 
+/* Sorted by Id for the binary search in GetStatusMessageP(), see check-tables in the Makefile */
 static const CommandStatusType PROGMEM StatusTable[] = {
     STATUS_TABLE_ENTRY(COMMAND_INFO_OK_ID, COMMAND_INFO_OK),
     STATUS_TABLE_ENTRY(COMMAND_INFO_OK_WITH_TEXT_ID, COMMAND_INFO_OK_WITH_TEXT),
@@ -387,27 +450,103 @@ static const CommandStatusType PROGMEM StatusTable[] = {
     //STATUS_TABLE_ENTRY(COMMAND_INFO_FALSE_ID, COMMAND_INFO_FALSE),
     //STATUS_TABLE_ENTRY(COMMAND_INFO_TRUE_ID, COMMAND_INFO_TRUE),
     STATUS_TABLE_ENTRY(COMMAND_ERR_TIMEOUT_ID, COMMAND_ERR_TIMEOUT),
+#ifdef SUPPORT_COMMAND_QUEUE
+    STATUS_TABLE_ENTRY(COMMAND_ERR_QUEUE_FULL_ID, COMMAND_ERR_QUEUE_FULL),
+#endif
 };
 
 static uint16_t BufferIdx;
 
 void (*CommandLinePendingTaskTimeout) (void) = NO_FUNCTION; // gets called on Timeout
+bool (*CommandLineMoreFunc) (char* OutParam) = NO_FUNCTION;
 static bool TaskPending = false;
 static uint16_t TaskPendingSince;
 
+#ifdef SUPPORT_COMMAND_QUEUE
+/* Lines received while a timeout command is pending, '\0' separated, oldest first */
+static char CommandQueue[COMMAND_QUEUE_SIZE];
+static uint8_t CommandQueueUsed = 0;
+static char CurrentTag[COMMAND_TAG_SIZE] = "";
+static char PendingTag[COMMAND_TAG_SIZE] = "";
+#endif
+
 static const char* GetStatusMessageP(CommandStatusIdType StatusId) {
-    uint8_t i;
-    for (i = 0; i < ARRAY_COUNT(StatusTable); i++) {
-        if (pgm_read_byte(&StatusTable[i].Id) == StatusId)
-            return StatusTable[i].Message;
+    uint8_t Low = 0;
+    uint8_t High = ARRAY_COUNT(StatusTable);
+
+    while (Low < High) {
+        uint8_t Mid = (Low + High) / 2;
+        CommandStatusIdType Id = pgm_read_byte(&StatusTable[Mid].Id);
+
+        if (Id == StatusId)
+            return StatusTable[Mid].Message;
+        else if (Id < StatusId)
+            Low = Mid + 1;
+        else
+            High = Mid;
     }
     return (void*) 0;
 }
 
+static const CommandEntryType* FindCommand(const char* Command) {
+    uint8_t Low = 0;
+    uint8_t High = ARRAY_COUNT(CommandTable) - 1; /* Without COMMAND_LIST_END */
+
+    while (Low < High) {
+        uint8_t Mid = (Low + High) / 2;
+        int Cmp = strcmp_P(Command, CommandTable[Mid].Command);
+
+        if (Cmp == 0)
+            return &CommandTable[Mid];
+        else if (Cmp > 0)
+            Low = Mid + 1;
+        else
+            High = Mid;
+    }
+    return NO_FUNCTION;
+}
+
+static void SendStatus(CommandStatusIdType StatusId, const char* Tag) {
+#ifdef SUPPORT_COMMAND_QUEUE
+  if (Tag[0] != '\0') {
+    TerminalSendString(Tag);
+    TerminalSendChar(CHAR_EXEC_MODE_PARAM);
+  }
+#endif
+  TerminalSendStringP(GetStatusMessageP(StatusId));
+  TerminalSendStringP(PSTR(STATUS_MESSAGE_TRAILER));
+}
+
+#ifdef SUPPORT_COMMAND_QUEUE
+/* Moves a leading #<Tag> out of the line into CurrentTag */
+static void SplitTag(char* Line) {
+  uint8_t TagLength = 0;
+  char* pCommand = Line;
+
+  CurrentTag[0] = '\0';
+  if (Line[0] != CHAR_TAG)
+    return;
+
+  while ( (*pCommand != '\0') && (*pCommand != CHAR_EXEC_MODE_PARAM) ) {
+    if (TagLength < COMMAND_TAG_SIZE - 1)
+      CurrentTag[TagLength++] = *pCommand;
+    pCommand++;
+  }
+  CurrentTag[TagLength] = '\0';
+
+  if (*pCommand == CHAR_EXEC_MODE_PARAM)
+    pCommand++;
+  memmove(Line, pCommand, strlen(pCommand) + 1);
+}
+#endif
+
 static CommandStatusIdType CallCommandFunc( const CommandEntryType* CommandEntry, char CommandDelimiter, char* pParam) {
   char* pTerminalBuffer = (char*) TerminalBuffer;
   CommandStatusIdType Status = COMMAND_ERR_INVALID_USAGE_ID;
 
+  /* Commands may access the application memory, so commit what is only held in RAM */
+  ApplicationFlush();
+
   /* Call appropriate function depending on CommandDelimiter */
   if (CommandDelimiter == CHAR_GET_MODE) {
     CommandGetFuncType GetFunc = pgm_read_ptr(&CommandEntry->GetFunc);
@@ -436,6 +575,9 @@ static CommandStatusIdType CallCommandFunc( const CommandEntryType* CommandEntry
     if (Status == TIMEOUT_COMMAND) {
         TaskPending = true;
         TaskPendingSince = SystemGetSysTick();
+#ifdef SUPPORT_COMMAND_QUEUE
+        strcpy(PendingTag, CurrentTag);
+#endif
     }
 
   /* This delimiter has not been registered with this command */
@@ -443,11 +585,15 @@ static CommandStatusIdType CallCommandFunc( const CommandEntryType* CommandEntry
 }
 
 static void DecodeCommand(void) {
-  uint8_t i;
+  const CommandEntryType* CommandEntry;
   bool CommandFound = false;
   CommandStatusIdType StatusId = COMMAND_ERR_UNKNOWN_CMD_ID;
   char* pTerminalBuffer = (char*) TerminalBuffer;
 
+#ifdef SUPPORT_COMMAND_QUEUE
+  SplitTag(pTerminalBuffer);
+#endif
+
   /* Do some sanity check first */
   if (!IS_COMMAND_DELIMITER(pTerminalBuffer[0])) {
     char* pCommandDelimiter = pTerminalBuffer;
@@ -461,18 +607,14 @@ static void DecodeCommand(void) {
     *pCommandDelimiter = '\0';
 
     /* Search in command table */
-    for (i = 0; i < ARRAY_COUNT(CommandTable); i++) {
-      if (strcmp_P(pTerminalBuffer, CommandTable[i].Command) == 0) {
-
+    CommandEntry = FindCommand(pTerminalBuffer);
+    if (CommandEntry != NO_FUNCTION) {
         /* Command found. Clear buffer, and call appropriate function */
         char* pParam = ++pCommandDelimiter;
         pTerminalBuffer[0] = '\0';
         CommandFound = true;
 
-        StatusId = CallCommandFunc(&CommandTable[i], CommandDelimiter, pParam);
-
-        break;
-      }
+        StatusId = CallCommandFunc(CommandEntry, CommandDelimiter, pParam);
     }
   }
 
@@ -480,15 +622,53 @@ static void DecodeCommand(void) {
       return;
 
   /* Send command status message */
-  TerminalSendStringP(GetStatusMessageP(StatusId));
-  TerminalSendStringP(PSTR(STATUS_MESSAGE_TRAILER));
+#ifdef SUPPORT_COMMAND_QUEUE
+  SendStatus(StatusId, CurrentTag);
+#else
+  SendStatus(StatusId, NULL);
+#endif
 
   if (CommandFound && (pTerminalBuffer[0] != '\0') ) {
     /* Send optional answer */
     TerminalSendString(pTerminalBuffer);
     TerminalSendStringP(PSTR(OPTIONAL_ANSWER_TRAILER));
+
+    /* Further lines of a long answer */
+    while ( (CommandLineMoreFunc != NO_FUNCTION) && CommandLineMoreFunc(pTerminalBuffer) ) {
+      TerminalSendString(pTerminalBuffer);
+      TerminalSendStringP(PSTR(OPTIONAL_ANSWER_TRAILER));
+    }
+  }
+  CommandLineMoreFunc = NO_FUNCTION;
+}
+
+#ifdef SUPPORT_COMMAND_QUEUE
+static void QueueLine(void) {
+  const char* pTerminalBuffer = (const char*) TerminalBuffer;
+  uint16_t Length = strlen(pTerminalBuffer) + 1;
+
+  if (CommandQueueUsed + Length > COMMAND_QUEUE_SIZE) {
+    /* Tell the host right away, it may resend the line later */
+    SplitTag((char*) TerminalBuffer);
+    SendStatus(COMMAND_ERR_QUEUE_FULL_ID, CurrentTag);
+    return;
+  }
+  memcpy(&CommandQueue[CommandQueueUsed], pTerminalBuffer, Length);
+  CommandQueueUsed += Length;
+}
+
+/* Run queued lines in order, until one of them starts a timeout command or a transfer */
+static void RunQueue(void) {
+  while ( (CommandQueueUsed > 0) && !TaskPending && !XModemIsBusy() ) {
+    uint8_t Length = strlen(CommandQueue) + 1;
+
+    memcpy(TerminalBuffer, CommandQueue, Length);
+    CommandQueueUsed -= Length;
+    memmove(CommandQueue, &CommandQueue[Length], CommandQueueUsed);
+    DecodeCommand();
   }
 }
+#endif
 
 void CommandLineInit(void) {
   BufferIdx = 0;
@@ -510,8 +690,18 @@ bool CommandLineProcessByte(uint8_t b) {
     TerminalBuffer[BufferIdx] = '\0';
     BufferIdx = 0;
 
+#ifdef SUPPORT_COMMAND_QUEUE
+        if (TaskPending || (CommandQueueUsed > 0)) {
+            /* Keep the order, the line runs once the ones before it are done */
+            QueueLine();
+            RunQueue();
+        } else {
+            DecodeCommand();
+        }
+#else
         if (!TaskPending)
     DecodeCommand();
+#endif
 
     } else if (b == '\b') {
     /* Backspace. Delete last character in buffer. */
@@ -529,8 +719,11 @@ bool CommandLineProcessByte(uint8_t b) {
 
 INLINE void Timeout(void) {
     TaskPending = false;
-    TerminalSendStringP(GetStatusMessageP(COMMAND_ERR_TIMEOUT_ID));
-    TerminalSendStringP(PSTR(STATUS_MESSAGE_TRAILER));
+#ifdef SUPPORT_COMMAND_QUEUE
+    SendStatus(COMMAND_ERR_TIMEOUT_ID, PendingTag);
+#else
+    SendStatus(COMMAND_ERR_TIMEOUT_ID, NULL);
+#endif
 
     if (CommandLinePendingTaskTimeout != NO_FUNCTION) {
         CommandLinePendingTaskTimeout(); // call the function that ends the task
@@ -544,6 +737,10 @@ void CommandLineTick(void) {
              && SYSTICK_DIFF_100MS(TaskPendingSince) >= GlobalSettings.ActiveSettingPtr->PendingTaskTimeout) {  // timeout expired
         Timeout();
     }
+#ifdef SUPPORT_COMMAND_QUEUE
+    /* Lines queued behind a task that has finished meanwhile */
+    RunQueue();
+#endif
 }
 
 void CommandLinePendingTaskBreak(void) {
@@ -558,8 +755,11 @@ void CommandLinePendingTaskFinished(CommandStatusIdType ReturnStatusID, char con
         return;
 
     TaskPending = false;
-    TerminalSendStringP(GetStatusMessageP(ReturnStatusID));
-    TerminalSendStringP(PSTR(STATUS_MESSAGE_TRAILER));
+#ifdef SUPPORT_COMMAND_QUEUE
+    SendStatus(ReturnStatusID, PendingTag);
+#else
+    SendStatus(ReturnStatusID, NULL);
+#endif
 
     if (OutMessage != NULL) {
         TerminalSendString(OutMessage);
@@ -567,29 +767,13 @@ void CommandLinePendingTaskFinished(CommandStatusIdType ReturnStatusID, char con
     }
 }
 
-void CommandLineAppendData(void const * const Buffer, uint16_t Bytes) {
-    char* pTerminalBuffer = (char*) TerminalBuffer;
-
-    uint16_t tmp = Bytes;
-    if (Bytes > (TERMINAL_BUFFER_SIZE / 2))
-        tmp = TERMINAL_BUFFER_SIZE / 2;
-    Bytes -= tmp;
-
-    BufferToHexString(pTerminalBuffer, TERMINAL_BUFFER_SIZE, Buffer, tmp);
-    TerminalSendString(pTerminalBuffer);
-
-    uint8_t i = 1;
-    while (Bytes > (TERMINAL_BUFFER_SIZE / 2)) {
-        Bytes -= TERMINAL_BUFFER_SIZE / 2;
-        BufferToHexString(pTerminalBuffer, TERMINAL_BUFFER_SIZE, Buffer + i * TERMINAL_BUFFER_SIZE / 2, TERMINAL_BUFFER_SIZE);
-        TerminalSendString(pTerminalBuffer);
-        i++;
-    }
-
-    if (Bytes > 0) {
-        BufferToHexString(pTerminalBuffer, TERMINAL_BUFFER_SIZE, Buffer + i * TERMINAL_BUFFER_SIZE / 2, Bytes);
-        TerminalSendString(pTerminalBuffer);
-    }
+/* Lets TerminalStream() read from RAM, the address being the pointer itself */
+static bool ReadRam(void* Buffer, uint32_t Address, uint32_t ByteCount) {
+    memcpy(Buffer, (const void*) (uintptr_t) Address, ByteCount);
+    return true;
+}
 
+void CommandLineAppendData(void const * const Buffer, uint16_t Bytes) {
+    TerminalStream(ReadRam, (uintptr_t) Buffer, Bytes, TERMINAL_STREAM_HEX, NULL, 0);
     TerminalSendStringP(PSTR(OPTIONAL_ANSWER_TRAILER));
 }
@@ -17,6 +17,10 @@ void CommandLineTick(void);
 
 void CommandLineAppendData(void const * const Buffer, uint16_t Bytes);
 
+/* For answers not fitting into the terminal buffer: a command function may set this. It gets
+ * called after the first answer line to fill the buffer with the next one, until it returns false. */
+extern bool (*CommandLineMoreFunc) (char* OutParam);
+
 /* Functions for timeout commands */
 void CommandLinePendingTaskFinished(CommandStatusIdType ReturnStatusID, char const * const OutMessage); // must be called, when the intended task is finished
 extern void (*CommandLinePendingTaskTimeout) (void); // gets called on timeout to end the pending task
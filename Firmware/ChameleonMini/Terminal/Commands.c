@@ -57,6 +57,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <avr/pgmspace.h>
+#include <util/crc16.h>
 #include "XModem.h"
 #include "../Settings.h"
 #include "../ChameleonMini.h"
@@ -71,6 +72,15 @@
 #include "../System.h"
 #include "../Button.h"
 #include "../AntennaLevel.h"
+#ifdef SUPPORT_LIVE_TRACE
+#include "../Trace.h"
+#endif
+#ifdef SUPPORT_LATENCY_STATS
+#include "../Latency.h"
+#endif
+#ifdef SUPPORT_PERF_COUNTERS
+#include "../Perf.h"
+#endif
 
 extern const PROGMEM CommandEntryType CommandTable[];
 
@@ -246,47 +256,23 @@ CommandStatusIdType CommandGetMemSize(char* OutParam) {
     return COMMAND_INFO_OK_WITH_TEXT_ID;
 }
 
-void _readAndSendWorkingMemChunk(uint32_t Address, uint16_t Size, uint16_t MaxSize, bool isHex) {
-    if((MaxSize <= TERMINAL_BUFFER_SIZE) && (Size <= MaxSize)) {
-        uint8_t buff[Size];
-        AppWorkingMemoryRead(buff, Address, Size);
-        if(isHex) {
-            char hexbuff[Size*2+3];
-            uint16_t zeroIndex = Size*2;
-            BufferToHexString(hexbuff, Size*2+3, buff, Size);
-            hexbuff[zeroIndex] = '\r';
-            hexbuff[zeroIndex+1] = '\n';
-            hexbuff[zeroIndex+2] = '\0';
-            TerminalSendString(hexbuff);
-        } else {
-            TerminalSendBlock(buff, Size);
-        }
-    }
-}
+/* Streamed straight from the flash in endpoint sized chunks, so any size takes the same stack */
+static uint8_t StreamWorkingMem(uint8_t Format) {
+    uint32_t ByteCount = AppWorkingMemorySize();
 
-uint8_t _readAndSendWorkingMem(uint16_t MaxSize, bool isHex) {
-    uint8_t ret = COMMAND_ERR_INVALID_USAGE_ID;
-    uint32_t bytesToWrite = AppWorkingMemorySize();
-    if( (MaxSize <= TERMINAL_BUFFER_SIZE) && bytesToWrite ) {
-        uint32_t rounds = bytesToWrite / MaxSize;
-        uint16_t offset = bytesToWrite % MaxSize;
-        for(uint32_t i=0; i < rounds; i++) {
-            _readAndSendWorkingMemChunk(i*MaxSize, MaxSize, MaxSize, isHex);
-        }
-        if(offset) {
-            _readAndSendWorkingMemChunk(rounds*MaxSize, offset, MaxSize, isHex);
-        }
-        ret = (isHex) ? (COMMAND_INFO_OK_WITH_TEXT_ID) : (COMMAND_INFO_OK_ID);
+    if (ByteCount == 0) {
+        return COMMAND_ERR_INVALID_USAGE_ID;
     }
-    return ret;
+    TerminalStream(AppWorkingMemoryRead, 0, ByteCount, Format, NULL, 0);
+    return (Format == TERMINAL_STREAM_RAW) ? COMMAND_INFO_OK_ID : COMMAND_INFO_OK_WITH_TEXT_ID;
 }
 
 CommandStatusIdType CommandGetWorkingMem(char* OutParam) {
-    return _readAndSendWorkingMem(16, true);
+    return StreamWorkingMem(16);
 }
 
 CommandStatusIdType CommandExecWorkingMem(char* OutMessage) {
-    return _readAndSendWorkingMem(TERMINAL_BUFFER_SIZE, false);
+    return StreamWorkingMem(TERMINAL_STREAM_RAW);
 }
 
 CommandStatusIdType CommandExecWorkingMemUpload(char* OutMessage) {
@@ -413,21 +399,55 @@ CommandStatusIdType CommandGetUltralightPassword(char* OutParam) {
 
 #ifdef CONFIG_MF_CLASSIC_DETECTION_SUPPORT
 CommandStatusIdType CommandGetDetection(char* OutParam) {
-    /* Read UID / s0-b0 */
-    AppWorkingMemoryRead(OutParam, MFCLASSIC_MEM_S0B0_ADDRESS, DETECTION_MEM_BLOCK0_SIZE);
-    /* Read saved nonce data from authentication */
-    AppWorkingMemoryRead(OutParam+DETECTION_MEM_BLOCK0_SIZE, DETECTION_MEM_DATA_START_ADDR, DETECTION_MEM_MFKEY_DATA_LEN);
+    uint16_t Crc;
+    /* Send UID / s0-b0 */
+    Crc = TerminalStream(AppWorkingMemoryRead, MFCLASSIC_MEM_S0B0_ADDRESS, DETECTION_MEM_BLOCK0_SIZE,
+                         TERMINAL_STREAM_RAW, _crc_ccitt_update, ISO14443A_CRCA_INIT);
+    /* Send saved nonce data from authentication */
+    Crc = TerminalStream(AppWorkingMemoryRead, DETECTION_MEM_DATA_START_ADDR, DETECTION_MEM_MFKEY_DATA_LEN,
+                         TERMINAL_STREAM_RAW, _crc_ccitt_update, Crc);
     /* Add file integrity to byte. This adds 2 bytes (209, 210) to DETECTION_MEM_APP_SIZE */
-    ISO14443AAppendCRCA(OutParam, DETECTION_MEM_APP_SIZE);
-    /* Send data + CRC */
-    for(uint8_t num=0; num < DETECTION_MEM_APP_SIZE+2; num++) {
-       TerminalSendChar(OutParam[num]);
-    }
-    OutParam[0] = 0;
+    TerminalSendByte((Crc >> 0) & 0xFF);
+    TerminalSendByte((Crc >> 8) & 0xFF);
     return COMMAND_INFO_OK_ID;
 }
 #endif
 
+#ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
+CommandStatusIdType CommandGetLogFilter(char* OutParam) {
+    MifareClassicAppLogGetFilter(OutParam, TERMINAL_BUFFER_SIZE);
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetLogFilter(char* OutMessage, const char* InParam) {
+    if (MifareClassicAppLogSetFilter(InParam)) {
+        return COMMAND_INFO_OK_ID;
+    }
+    return COMMAND_ERR_INVALID_PARAM_ID;
+}
+
+/* LOGSYNC=<sequence number> sends the log records from that number on by XModem */
+CommandStatusIdType CommandSetLogSync(char* OutMessage, const char* InParam) {
+    uint32_t Sequence = 0;
+
+    if (GlobalSettings.ActiveSettingPtr->Configuration != CONFIG_MF_CLASSIC_LOG) {
+        return COMMAND_ERR_INVALID_USAGE_ID;
+    }
+    if (*InParam == '\0') {
+        return COMMAND_ERR_INVALID_PARAM_ID;
+    }
+    while (*InParam != '\0') {
+        if ( (*InParam < '0') || (*InParam > '9') || (Sequence > (UINT32_MAX - 9) / 10) ) {
+            return COMMAND_ERR_INVALID_PARAM_ID;
+        }
+        Sequence = Sequence * 10 + (*InParam++ - '0');
+    }
+    MifareClassicAppLogSyncStart(Sequence);
+    XModemSend(MifareClassicAppLogSyncXModem);
+    return COMMAND_INFO_XMODEM_WAIT_ID;
+}
+#endif
+
 #ifdef SUPPORT_MF_CLASSIC_MAGIC_MODE
 CommandStatusIdType CommandGetUidMode(char* OutParam) {
     snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%u"), GlobalSettings.UidMode);
@@ -447,6 +467,122 @@ CommandStatusIdType CommandSetUidMode(char* OutMessage, const char* InParam) {
 }
 #endif
 
+#ifdef SUPPORT_LATENCY_STATS
+static uint8_t LatencyLine;
+
+static uint16_t LatencyPrintBins(char* OutParam, uint16_t MaxChars, const uint16_t* Bins) {
+    uint16_t Count = 0;
+    for (uint8_t i = 0; i < LATENCY_BINS; i++) {
+        Count += snprintf_P(&OutParam[Count], MaxChars - Count, (i == 0) ? PSTR("%u") : PSTR(",%u"), Bins[i]);
+    }
+    return Count;
+}
+
+/* One line per command byte seen: command, frames, late answers, then the processing
+ * and the answer start histograms */
+static bool LatencyMore(char* OutParam) {
+    const LatencySlotType* Slot;
+    uint16_t Count;
+
+    do {
+        if (LatencyLine >= LATENCY_SLOTS) {
+            return false;
+        }
+        Slot = LatencyGetSlot(LatencyLine++);
+    } while (!Slot->Used);
+
+    if (LatencyLine == LATENCY_SLOTS) {
+        Count = snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("**"));
+    } else {
+        Count = snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%02X"), Slot->Command);
+    }
+    Count += snprintf_P(&OutParam[Count], TERMINAL_BUFFER_SIZE - Count, PSTR(" N:%u MISSED:%u PROC:"), Slot->Frames, Slot->Missed);
+    Count += LatencyPrintBins(&OutParam[Count], TERMINAL_BUFFER_SIZE - Count, Slot->Process);
+    Count += snprintf_P(&OutParam[Count], TERMINAL_BUFFER_SIZE - Count, PSTR(" ANS:"));
+    LatencyPrintBins(&OutParam[Count], TERMINAL_BUFFER_SIZE - Count, Slot->Answer);
+    return true;
+}
+
+CommandStatusIdType CommandGetLatency(char* OutParam) {
+    uint16_t Count = snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("FRAMES:%lu,MISSED:%lu,BINS_US:"),
+                                LatencyGetFrames(), LatencyGetMissed());
+    /* Upper bounds of all bins but the last one */
+    for (uint8_t i = 0; i < (LATENCY_BINS - 1); i++) {
+        Count += snprintf_P(&OutParam[Count], TERMINAL_BUFFER_SIZE - Count, (i == 0) ? PSTR("%u") : PSTR(",%u"),
+                            LATENCY_BIN0_US << i);
+    }
+    LatencyLine = 0;
+    CommandLineMoreFunc = LatencyMore;
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetLatency(char* OutMessage, const char* InParam) {
+    if (strcmp_P(InParam, PSTR(COMMAND_LATENCY_RESET)) == 0) {
+        LatencyReset();
+        return COMMAND_INFO_OK_ID;
+    }
+    return COMMAND_ERR_INVALID_PARAM_ID;
+}
+#endif
+
+#ifdef SUPPORT_PERF_COUNTERS
+static uint8_t PerfLine;
+
+/* One line per configuration that received frames */
+static bool PerfMore(char* OutParam) {
+    while (PerfLine < CONFIG_COUNT) {
+        uint8_t Config = PerfLine++;
+        if (PerfCounters.Frames[Config] > 0) {
+            ConfigurationGetNameForId(Config, OutParam, TERMINAL_BUFFER_SIZE);
+            uint16_t Count = strlen(OutParam);
+            snprintf_P(&OutParam[Count], TERMINAL_BUFFER_SIZE - Count, PSTR(" FRAMES:%u,BADCRC:%u"),
+                       PerfCounters.Frames[Config], PerfCounters.FramesBadCRC[Config]);
+            return true;
+        }
+    }
+    return false;
+}
+
+CommandStatusIdType CommandGetPerf(char* OutParam) {
+    snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("SPI:%lu,BUSY:%lu,PROGRAM:%lu,ERASE:%lu,CRYPTO1:%lu,CRC:%lu,FDTMISS:%lu,FDTFALLBACK:%lu,DROPPED:%lu"),
+               PerfCounters.SPIBytes, PerfCounters.FlashBusyPolls, PerfCounters.FlashPrograms,
+               PerfCounters.FlashErases, PerfCounters.Crypto1Clocks, PerfCounters.CRCBytes,
+               PerfCounters.FrameDelayMisses, PerfCounters.FrameDelayFallbacks, PerfCounters.FramesDropped);
+    PerfLine = 0;
+    CommandLineMoreFunc = PerfMore;
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetPerf(char* OutMessage, const char* InParam) {
+    if (strcmp_P(InParam, PSTR(COMMAND_PERF_RESET)) == 0) {
+        PerfReset();
+        return COMMAND_INFO_OK_ID;
+    }
+    return COMMAND_ERR_INVALID_PARAM_ID;
+}
+#endif
+
+#ifdef SUPPORT_LIVE_TRACE
+CommandStatusIdType CommandGetTrace(char* OutParam) {
+    snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%c,DROPPED:%lu"),
+               TraceEnabled ? COMMAND_CHAR_TRUE : COMMAND_CHAR_FALSE, TraceGetDropped());
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetTrace(char* OutMessage, const char* InParam) {
+    if (InParam[1] == '\0') {
+        if (InParam[0] == COMMAND_CHAR_TRUE) {
+            TraceSetEnabled(true);
+            return COMMAND_INFO_OK_ID;
+        } else if (InParam[0] == COMMAND_CHAR_FALSE) {
+            TraceSetEnabled(false);
+            return COMMAND_INFO_OK_ID;
+        }
+    }
+    return COMMAND_ERR_INVALID_PARAM_ID;
+}
+#endif
+
 CommandStatusIdType CommandExecClearAll(char* OutMessage) {
     MemoryClearAll();
     for(uint8_t i = SETTINGS_FIRST; i <= SETTINGS_LAST; i++) {
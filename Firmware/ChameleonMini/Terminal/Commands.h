@@ -86,6 +86,8 @@
 #define COMMAND_ERR_INVALID_PARAM       "INVALID PARAMETER"
 #define COMMAND_ERR_TIMEOUT_ID          203
 #define COMMAND_ERR_TIMEOUT             "TIMEOUT"
+#define COMMAND_ERR_QUEUE_FULL_ID       204
+#define COMMAND_ERR_QUEUE_FULL          "QUEUE FULL"
 #define TIMEOUT_COMMAND                 255 // this is just for the CommandLine module to know that this is a timeout command
 
 
@@ -94,6 +96,9 @@
 
 #define COMMAND_UID_BUFSIZE             32
 
+#define COMMAND_QUEUE_SIZE              128 /* Lines waiting for a pending timeout command */
+#define COMMAND_TAG_SIZE                8 /* Including the leading '#' and the '\0' */
+
 typedef uint8_t CommandStatusIdType;
 typedef const char CommandStatusMessageType[MAX_STATUS_LENGTH];
 
@@ -196,12 +201,41 @@ CommandStatusIdType CommandGetUltralightPassword(char* OutParam);
 CommandStatusIdType CommandGetDetection(char* OutParam);
 #endif
 
+#ifdef CONFIG_MF_CLASSIC_LOG_SUPPORT
+#define COMMAND_LOGFILTER           "LOGFILTER"
+CommandStatusIdType CommandGetLogFilter(char* OutParam);
+CommandStatusIdType CommandSetLogFilter(char* OutMessage, const char* InParam);
+
+#define COMMAND_LOGSYNC             "LOGSYNC"
+CommandStatusIdType CommandSetLogSync(char* OutMessage, const char* InParam);
+#endif
+
 #ifdef SUPPORT_MF_CLASSIC_MAGIC_MODE
 #define COMMAND_UIDMOD           "UIDMODE"
 CommandStatusIdType CommandGetUidMode(char* OutParam);
 CommandStatusIdType CommandSetUidMode(char* OutMessage, const char* InParam);
 #endif
 
+#ifdef SUPPORT_LATENCY_STATS
+#define COMMAND_LATENCY             "LATENCY"
+#define COMMAND_LATENCY_RESET       "RESET"
+CommandStatusIdType CommandGetLatency(char* OutParam);
+CommandStatusIdType CommandSetLatency(char* OutMessage, const char* InParam);
+#endif
+
+#ifdef SUPPORT_PERF_COUNTERS
+#define COMMAND_PERF                "PERF"
+#define COMMAND_PERF_RESET          "RESET"
+CommandStatusIdType CommandGetPerf(char* OutParam);
+CommandStatusIdType CommandSetPerf(char* OutMessage, const char* InParam);
+#endif
+
+#ifdef SUPPORT_LIVE_TRACE
+#define COMMAND_TRACE               "TRACE"
+CommandStatusIdType CommandGetTrace(char* OutParam);
+CommandStatusIdType CommandSetTrace(char* OutMessage, const char* InParam);
+#endif
+
 #define COMMAND_CLEARALL            "CLEARALL"
 CommandStatusIdType CommandExecClearAll(char* OutMessage);
 
@@ -1,6 +1,16 @@
+#include <string.h>
 #include "Terminal.h"
 #include "../System.h"
 #include "../LUFADescriptors.h"
+#ifdef SUPPORT_LIVE_TRACE
+#include "../Trace.h"
+#endif
+#ifdef SUPPORT_USB_INTERRUPT
+#include <avr/interrupt.h>
+#endif
+#ifdef SUPPORT_BINARY_PROTOCOL
+#include "BinaryProtocol.h"
+#endif
 
 #define INIT_DELAY		(2000 / SYSTEM_TICK_MS)
 
@@ -27,16 +37,155 @@ uint8_t TerminalBuffer[TERMINAL_BUFFER_SIZE];
 TerminalStateEnum TerminalState = TERMINAL_UNINITIALIZED;
 static uint8_t TerminalInitDelay = INIT_DELAY;
 
+#ifdef SUPPORT_USB_INTERRUPT
+/* The USB interrupt moves whole packets between the endpoints and these rings,
+ * the main loop only ever touches the rings. Each index is written by one side only. */
+static uint8_t TerminalRxRing[TERMINAL_RX_RING_SIZE];
+static volatile uint8_t TerminalRxHead = 0; /* Written by the interrupt */
+static volatile uint8_t TerminalRxTail = 0; /* Written by the main loop */
+static uint8_t TerminalTxRing[TERMINAL_TX_RING_SIZE];
+static volatile uint8_t TerminalTxHead = 0; /* Written by the main loop */
+static volatile uint8_t TerminalTxTail = 0; /* Written by the interrupt */
+static volatile bool TerminalRxStalled = false; /* OUT packet left in the endpoint, ring was full */
+static bool TerminalTxFullPacket = false; /* Last IN packet was full, a short one has to follow */
+
+INLINE bool TerminalIsConnected(void) {
+    return (USB_DeviceState == DEVICE_STATE_Configured) && (TerminalHandle.State.LineEncoding.BaudRateBPS != 0);
+}
+
+INLINE void TerminalEnableEndpointInterrupt(uint8_t Address) {
+    USB_EndpointTable_t* Table = (USB_EndpointTable_t*) USB.EPPTR;
+    uint8_t EPNum = Address & ENDPOINT_EPNUM_MASK;
+
+    if (Address & ENDPOINT_DIR_IN) {
+        Table->Endpoints[EPNum].IN.CTRL &= ~USB_EP_INTDSBL_bm;
+    } else {
+        Table->Endpoints[EPNum].OUT.CTRL &= ~USB_EP_INTDSBL_bm;
+    }
+}
+
+/* At most one packet per direction, so the time spent in the interrupt stays bounded */
+static void TerminalService(void) {
+    if (!TerminalIsConnected()) {
+        /* Nobody listening, do not let stale output reach the next host */
+        TerminalTxTail = TerminalTxHead;
+        return;
+    }
+
+    Endpoint_SelectEndpoint(TerminalHandle.Config.DataOUTEndpoint.Address);
+    if (Endpoint_IsOUTReceived()) {
+        uint8_t Head = TerminalRxHead;
+        while (Endpoint_BytesInEndpoint() > 0) {
+            uint8_t Next = (Head + 1) & (TERMINAL_RX_RING_SIZE - 1);
+            if (Next == TerminalRxTail) {
+                break;
+            }
+            TerminalRxRing[Head] = Endpoint_Read_8();
+            Head = Next;
+        }
+        TerminalRxHead = Head;
+        if (Endpoint_BytesInEndpoint() == 0) {
+            /* Packet consumed, let the host send the next one */
+            Endpoint_ClearOUT();
+            TerminalRxStalled = false;
+        } else {
+            /* Host gets NAKed until the main loop made room */
+            TerminalRxStalled = true;
+        }
+    }
+
+    Endpoint_SelectEndpoint(TerminalHandle.Config.DataINEndpoint.Address);
+    if ( ((TerminalTxTail != TerminalTxHead) || TerminalTxFullPacket) && Endpoint_IsINReady() ) {
+        uint8_t Tail = TerminalTxTail;
+        while ( (Tail != TerminalTxHead) && Endpoint_IsReadWriteAllowed() ) {
+            Endpoint_Write_8(TerminalTxRing[Tail]);
+            Tail = (Tail + 1) & (TERMINAL_TX_RING_SIZE - 1);
+        }
+        TerminalTxTail = Tail;
+        TerminalTxFullPacket = !Endpoint_IsReadWriteAllowed();
+        Endpoint_ClearIN();
+    }
+}
+
+/* Service the endpoints from the main loop, for data the interrupt cannot know about */
+static void TerminalKick(void) {
+    PMIC.CTRL &= ~PMIC_LOLVLEN_bm;
+    TerminalService();
+    PMIC.CTRL |= PMIC_LOLVLEN_bm;
+}
+
+ISR(USB_TRNCOMPL_vect) {
+    USB.INTFLAGSBCLR = USB_SETUPIF_bm | USB_TRNIF_bm;
+    USB_USBTask();
+    TerminalService();
+}
+
+uint8_t TerminalSendFree(void) {
+    return (TerminalTxTail - TerminalTxHead - 1) & (TERMINAL_TX_RING_SIZE - 1);
+}
+
+/* Ring full, wait for the host like CDC_Device_SendByte would. False if the data has to be dropped. */
+static bool TerminalWaitFree(void) {
+    uint16_t StartFrame = USB_Device_GetFrameNumber();
+
+    while (TerminalSendFree() == 0) {
+        if (!TerminalIsConnected() || ((uint16_t) (USB_Device_GetFrameNumber() - StartFrame) > USB_STREAM_TIMEOUT_MS)) {
+            return false;
+        }
+        TerminalKick();
+    }
+    return true;
+}
+
+/* Copies up to the wrap around or the free space at once */
+static void TerminalQueue(const uint8_t* Buffer, uint16_t ByteCount, bool FromFlash) {
+    while (ByteCount > 0) {
+        uint8_t Head = TerminalTxHead;
+        uint8_t Chunk;
+
+        if ( (TerminalSendFree() == 0) && !TerminalWaitFree() ) {
+            return;
+        }
+        Chunk = MIN(TerminalSendFree(), TERMINAL_TX_RING_SIZE - Head);
+        Chunk = MIN(Chunk, ByteCount);
+        if (FromFlash) {
+            memcpy_P(&TerminalTxRing[Head], Buffer, Chunk);
+        } else {
+            memcpy(&TerminalTxRing[Head], Buffer, Chunk);
+        }
+        TerminalTxHead = (Head + Chunk) & (TERMINAL_TX_RING_SIZE - 1);
+        Buffer += Chunk;
+        ByteCount -= Chunk;
+    }
+}
+
+void TerminalSendByte(uint8_t Byte) {
+    uint8_t Head = TerminalTxHead;
+
+    if ( (TerminalSendFree() == 0) && !TerminalWaitFree() ) {
+        return;
+    }
+    TerminalTxRing[Head] = Byte;
+    TerminalTxHead = (Head + 1) & (TERMINAL_TX_RING_SIZE - 1);
+}
+
+void TerminalSendString(const char* s) {
+    TerminalQueue((const uint8_t*) s, strlen(s), false);
+}
+
+void TerminalSendStringP(const char* s) {
+    TerminalQueue((const uint8_t*) s, strlen_P(s), true);
+}
+#else
 void TerminalSendString(const char* s) {
     CDC_Device_SendString(&TerminalHandle, s);
 }
 
 void TerminalSendStringP(const char* s) {
-    char c;
-    while( (c = pgm_read_byte(s++)) != '\0' ) {
-        TerminalSendChar(c);
-    }
+    /* Goes out in endpoint sized blocks, like TerminalSendString */
+    CDC_Device_SendString_P(&TerminalHandle, s);
 }
+#endif
 
 #if 0
 void TerminalSendBuffer(void* Buffer, uint16_t ByteCount) {
@@ -47,16 +196,91 @@ void TerminalSendBuffer(void* Buffer, uint16_t ByteCount) {
 #endif
 
 void TerminalSendBlock(const void* Buffer, uint16_t ByteCount) {
+#ifdef SUPPORT_USB_INTERRUPT
+    TerminalQueue((const uint8_t*) Buffer, ByteCount, false);
+#else
     CDC_Device_SendData(&TerminalHandle, Buffer, ByteCount);
+#endif
+}
+
+uint16_t TerminalStream(TerminalReadFuncType ReadFunc, uint32_t Address, uint32_t ByteCount,
+                        uint8_t Format, TerminalCrcFuncType CrcFunc, uint16_t Crc) {
+    uint8_t Chunk[TERMINAL_STREAM_CHUNK];
+    uint8_t ChunkSize;
+
+    if (Format == TERMINAL_STREAM_RAW) {
+        ChunkSize = TERMINAL_STREAM_CHUNK;
+    } else if (Format == TERMINAL_STREAM_HEX) {
+        ChunkSize = TERMINAL_STREAM_CHUNK / 2;
+    } else {
+        ChunkSize = MIN(Format, TERMINAL_STREAM_HEX_LINE_MAX);
+    }
+
+    while (ByteCount > 0) {
+        uint8_t Count = MIN(ByteCount, ChunkSize);
+        /* Raw data goes to the start, hex data behind the room its encoding needs */
+        uint8_t* Data = (Format == TERMINAL_STREAM_RAW) ? Chunk : &Chunk[Count];
+        uint8_t Length = Count;
+        uint8_t i;
+
+        ReadFunc(Data, Address, Count);
+        if (CrcFunc != NULL) {
+            for (i = 0; i < Count; i++) {
+                Crc = CrcFunc(Crc, Data[i]);
+            }
+        }
+
+        if (Format != TERMINAL_STREAM_RAW) {
+            /* Expanding front to back only overwrites bytes already read */
+            for (i = 0; i < Count; i++) {
+                uint8_t Byte = Data[i];
+                Chunk[2 * i + 0] = NIBBLE_TO_HEXCHAR(Byte >> 4);
+                Chunk[2 * i + 1] = NIBBLE_TO_HEXCHAR(Byte & 0x0F);
+            }
+            Length = 2 * Count;
+            if (Format != TERMINAL_STREAM_HEX) {
+                Chunk[Length++] = '\r';
+                Chunk[Length++] = '\n';
+            }
+        }
+
+        TerminalSendBlock(Chunk, Length);
+        Address += Count;
+        ByteCount -= Count;
+    }
+
+    return Crc;
+}
+
+#ifdef SUPPORT_USB_INTERRUPT
+static int16_t ReceiveByte(void) {
+    uint8_t Tail = TerminalRxTail;
+    int16_t Byte;
+
+    if (Tail == TerminalRxHead) {
+        return -1;
+    }
+    Byte = TerminalRxRing[Tail];
+    TerminalRxTail = (Tail + 1) & (TERMINAL_RX_RING_SIZE - 1);
+    return Byte;
 }
+#else
+static int16_t ReceiveByte(void) {
+    return CDC_Device_ReceiveByte(&TerminalHandle);
+}
+#endif
 
 static void ProcessByte(void) {
-    int16_t Byte = CDC_Device_ReceiveByte(&TerminalHandle);
+    int16_t Byte = ReceiveByte();
 
     if (Byte >= 0) {
         /* Byte received */
         if (XModemProcessByte(Byte)) {
             /* XModem handled the byte */
+#ifdef SUPPORT_BINARY_PROTOCOL
+        } else if (BinaryProtocolProcessByte(Byte)) {
+            /* Binary mode handled the byte */
+#endif
         } else if (CommandLineProcessByte(Byte)) {
             /* CommandLine handled the byte */
         }
@@ -77,6 +301,10 @@ static void SenseVBus(void) {
     	if (--TerminalInitDelay == 0) {
             SystemStartUSBClock();
             USB_Init();
+#ifdef SUPPORT_USB_INTERRUPT
+            /* LUFA only enables the bus events, endpoints are polled otherwise */
+            USB.INTCTRLB = USB_TRNIE_bm | USB_SETUPIE_bm;
+#endif
             TerminalState = TERMINAL_INITIALIZED;
     	}
     	break;
@@ -107,14 +335,35 @@ void TerminalInit(void) {
 }
 
 void TerminalTask(void) {
+#ifdef SUPPORT_USB_INTERRUPT
+    if ( (TerminalTxTail != TerminalTxHead) || TerminalRxStalled ) {
+        /* The endpoints may be idle, so no interrupt would pick this up */
+        TerminalKick();
+    }
+#else
 	CDC_Device_USBTask(&TerminalHandle);
 	USB_USBTask();
+#endif
+#ifdef SUPPORT_LIVE_TRACE
+    if (TraceTask()) {
+        /* Keep answers out of a partly sent trace record */
+        return;
+    }
+#endif
     ProcessByte();
 }
 
 void TerminalTick(void) {
 	SenseVBus();
+#ifdef SUPPORT_LIVE_TRACE
+    if (TraceTask()) {
+        return;
+    }
+#endif
     XModemTick();
+#ifdef SUPPORT_BINARY_PROTOCOL
+    BinaryProtocolTick();
+#endif
     CommandLineTick();
 }
 
@@ -126,9 +375,24 @@ void EVENT_USB_Device_Connect(void) {
 void EVENT_USB_Device_Disconnect(void) {
 }
 
+#ifdef SUPPORT_USB_INTERRUPT
+/** Event handler for the library USB Reset event. */
+void EVENT_USB_Device_Reset(void) {
+    /* Control endpoint has just been set up again, with interrupts disabled */
+    TerminalEnableEndpointInterrupt(ENDPOINT_CONTROLEP);
+    TerminalEnableEndpointInterrupt(ENDPOINT_CONTROLEP | ENDPOINT_DIR_IN);
+}
+#endif
+
 /** Event handler for the library USB Configuration Changed event. */
 void EVENT_USB_Device_ConfigurationChanged(void) {
     CDC_Device_ConfigureEndpoints(&TerminalHandle);
+#ifdef SUPPORT_USB_INTERRUPT
+    TerminalEnableEndpointInterrupt(TerminalHandle.Config.DataINEndpoint.Address);
+    TerminalEnableEndpointInterrupt(TerminalHandle.Config.DataOUTEndpoint.Address);
+    TerminalRxStalled = false;
+    TerminalTxFullPacket = false;
+#endif
 }
 
 /** Event handler for the library USB Control Request reception event. */
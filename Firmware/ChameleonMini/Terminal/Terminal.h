@@ -18,6 +18,22 @@
 
 #define TERMINAL_BUFFER_SIZE	256
 
+/* TerminalStream() works in chunks of one full CDC IN packet on the stack */
+#define TERMINAL_STREAM_CHUNK       64
+#define TERMINAL_STREAM_RAW         0x00 /* Bytes as they are */
+#define TERMINAL_STREAM_HEX         0xFF /* Hex, without line breaks */
+#define TERMINAL_STREAM_HEX_LINE_MAX ((TERMINAL_STREAM_CHUNK - 2) / 2)
+/* Any other format value: hex with \r\n after that many bytes, at most TERMINAL_STREAM_HEX_LINE_MAX */
+
+#ifdef SUPPORT_USB_INTERRUPT
+/* Rings between the USB interrupt and the main loop, sizes are powers of two */
+#define TERMINAL_RX_RING_SIZE   64
+#define TERMINAL_TX_RING_SIZE   128
+#endif
+
+typedef bool (*TerminalReadFuncType) (void* Buffer, uint32_t Address, uint32_t ByteCount);
+typedef uint16_t (*TerminalCrcFuncType) (uint16_t Crc, uint8_t Byte);
+
 typedef enum {
 	TERMINAL_UNINITIALIZED,
 	TERMINAL_INITIALIZING,
@@ -34,8 +50,15 @@ void TerminalTask(void);
 void TerminalTick(void);
 
 /*void TerminalSendBuffer(void* Buffer, uint16_t ByteCount);*/
+#ifdef SUPPORT_USB_INTERRUPT
+void TerminalSendByte(uint8_t Byte);
+uint8_t TerminalSendFree(void);
+#else
 INLINE void TerminalSendByte(uint8_t Byte);
+#endif
 void TerminalSendBlock(const void* Buffer, uint16_t ByteCount);
+uint16_t TerminalStream(TerminalReadFuncType ReadFunc, uint32_t Address, uint32_t ByteCount,
+                        uint8_t Format, TerminalCrcFuncType CrcFunc, uint16_t Crc);
 
 INLINE void TerminalSendChar(char c);
 void TerminalSendString(const char* s);
@@ -46,7 +69,13 @@ void EVENT_USB_Device_Disconnect(void);
 void EVENT_USB_Device_ConfigurationChanged(void);
 void EVENT_USB_Device_ControlRequest(void);
 
+#ifdef SUPPORT_USB_INTERRUPT
+void EVENT_USB_Device_Reset(void);
+
+INLINE void TerminalSendChar(char c) { TerminalSendByte(c); }
+#else
 INLINE void TerminalSendChar(char c) { CDC_Device_SendByte(&TerminalHandle, c); }
 INLINE void TerminalSendByte(uint8_t Byte) { CDC_Device_SendByte(&TerminalHandle, Byte); }
+#endif
 
 #endif /* TERMINAL_H_ */
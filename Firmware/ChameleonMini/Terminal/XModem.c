@@ -1,21 +1,29 @@
+#include <util/crc16.h>
 #include "XModem.h"
 #include "Terminal.h"
 
 #define BYTE_NAK        0x15
 #define BYTE_SOH        0x01
+#define BYTE_STX        0x02
+#define BYTE_C          'C'
 #define BYTE_ACK        0x06
 #define BYTE_CAN        0x18
 #define BYTE_EOF        0x1A
 #define BYTE_EOT        0x04
 
 #define XMODEM_BLOCK_SIZE   128
+#define XMODEM_1K_BLOCK_SIZE 1024 /* STX frames, only in CRC mode */
+#define XMODEM_1K_CHUNKS    (XMODEM_1K_BLOCK_SIZE / XMODEM_BLOCK_SIZE)
+#define XMODEM_1K_ALL_CHUNKS 0xFF /* One bit per chunk */
 
 #define RECV_INIT_TIMEOUT   5  /* x 100ms */
 #define RECV_INIT_COUNT     20 /* 10 secs */
+#define RECV_CRC_COUNT      3  /* 'C' requests before falling back to checksum mode */
 #define SEND_INIT_TIMEOUT   100 /* x 100ms */
 
 #define FIRST_FRAME_NUMBER  1
 #define CHECKSUM_INIT_VALUE 0
+#define CRC_INIT_VALUE      0
 
 static enum {
     STATE_OFF,
@@ -25,6 +33,7 @@ static enum {
     STATE_RECEIVE_FRAMENUM2,
     STATE_RECEIVE_DATA,
     STATE_RECEIVE_PROCESS,
+    STATE_RECEIVE_CRC_LOW,
     STATE_SEND_INIT,
     STATE_SEND_WAIT,
     STATE_SEND_EOT
@@ -33,9 +42,17 @@ static enum {
 static uint8_t CurrentFrameNumber;
 static uint8_t ReceivedFrameNumber;
 static uint8_t Checksum;
+static uint16_t Crc;
+static uint16_t ReceivedCrc;
+static bool CrcMode;
+static bool Cancelled; /* Callback refused part of a 1K frame */
+static bool FrameVerified; /* ChunkCrc holds the chunks of a valid copy of the current 1K frame */
+static uint8_t ChunksWritten; /* Of the current 1K frame, one bit per chunk */
+static uint16_t ChunkCrc[XMODEM_1K_CHUNKS];
 static uint8_t RetryCount;
 static uint16_t RetryTimeout;
 static uint16_t BufferIdx;
+static uint16_t FrameSize;
 static uint32_t BlockAddress;
 
 static XModemCallbackType CallbackFunc;
@@ -51,6 +68,130 @@ static uint8_t CalcChecksum(const void* Buffer, uint16_t ByteCount) {
     return Checksum;
 }
 
+static uint16_t CalcCrc(uint16_t Crc, const void* Buffer, uint16_t ByteCount) {
+    uint8_t* DataPtr = (uint8_t*) Buffer;
+
+    while(ByteCount--) {
+        Crc = _crc_xmodem_update(Crc, *DataPtr++);
+    }
+
+    return Crc;
+}
+
+/* 1K frames are too large for RAM. They are streamed through TerminalBuffer one
+ * XMODEM_BLOCK_SIZE chunk at a time, the last chunk is kept in the upper half
+ * of TerminalBuffer from the look ahead in SendNextFrame(). */
+static void SendFrame(void) {
+    TerminalSendByte((FrameSize == XMODEM_1K_BLOCK_SIZE) ? BYTE_STX : BYTE_SOH);
+    TerminalSendByte(CurrentFrameNumber);
+    TerminalSendByte(255 - CurrentFrameNumber);
+
+    if (FrameSize == XMODEM_1K_BLOCK_SIZE) {
+        uint16_t FrameCrc = TerminalStream(CallbackFunc, BlockAddress, XMODEM_1K_BLOCK_SIZE - XMODEM_BLOCK_SIZE,
+                                           TERMINAL_STREAM_RAW, _crc_xmodem_update, CRC_INIT_VALUE);
+
+        FrameCrc = CalcCrc(FrameCrc, &TerminalBuffer[XMODEM_BLOCK_SIZE], XMODEM_BLOCK_SIZE);
+        TerminalSendBlock(&TerminalBuffer[XMODEM_BLOCK_SIZE], XMODEM_BLOCK_SIZE);
+        TerminalSendByte(FrameCrc >> 8);
+        TerminalSendByte(FrameCrc & 0xFF);
+    } else {
+        TerminalSendBlock(TerminalBuffer, XMODEM_BLOCK_SIZE);
+        if (CrcMode) {
+            uint16_t FrameCrc = CalcCrc(CRC_INIT_VALUE, TerminalBuffer, XMODEM_BLOCK_SIZE);
+            TerminalSendByte(FrameCrc >> 8);
+            TerminalSendByte(FrameCrc & 0xFF);
+        } else {
+            TerminalSendByte(CalcChecksum(TerminalBuffer, XMODEM_BLOCK_SIZE));
+        }
+    }
+}
+
+/* Use a 1K frame whenever its last chunk still holds data, 128 byte frames for the tail */
+static bool SendNextFrame(void) {
+    if (CrcMode && CallbackFunc(&TerminalBuffer[XMODEM_BLOCK_SIZE], BlockAddress + XMODEM_1K_BLOCK_SIZE - XMODEM_BLOCK_SIZE, XMODEM_BLOCK_SIZE)) {
+        FrameSize = XMODEM_1K_BLOCK_SIZE;
+    } else if (CallbackFunc(TerminalBuffer, BlockAddress, XMODEM_BLOCK_SIZE)) {
+        FrameSize = XMODEM_BLOCK_SIZE;
+    } else {
+        return false;
+    }
+
+    SendFrame();
+    return true;
+}
+
+/* A 1K frame does not fit into RAM, so it cannot be checked before it is passed on.
+ * Instead, the first valid copy is only checked and the CRC of each chunk is kept. It is
+ * then NAKed, and the chunks of the copies that follow are passed on only when they
+ * match. Like this, the callback never gets data that has not been verified. */
+static void ReceiveChunk(uint8_t ChunkIdx) {
+    uint16_t DataCrc = CalcCrc(CRC_INIT_VALUE, TerminalBuffer, XMODEM_BLOCK_SIZE);
+    uint8_t ChunkMask = 1 << ChunkIdx;
+
+    if (!FrameVerified) {
+        ChunkCrc[ChunkIdx] = DataCrc;
+    } else if ( !(ChunksWritten & ChunkMask) && (ChunkCrc[ChunkIdx] == DataCrc) ) {
+        if (CallbackFunc(TerminalBuffer, BlockAddress + ChunkIdx * XMODEM_BLOCK_SIZE, XMODEM_BLOCK_SIZE)) {
+            ChunksWritten |= ChunkMask;
+        } else {
+            Cancelled = true;
+        }
+    }
+}
+
+static void NextReceiveFrame(void) {
+    /* Data passed on. Proceed to next frame and send ACK */
+    CurrentFrameNumber++;
+    BlockAddress += FrameSize;
+    FrameVerified = false;
+    TerminalSendChar(BYTE_ACK);
+    State = STATE_RECEIVE_WAIT;
+}
+
+static void ReceiveFrameDone(bool Valid) {
+    if (ReceivedFrameNumber == CurrentFrameNumber) {
+        /* This is the expected frame */
+        if (Cancelled) {
+            /* Application signalled to cancel while the frame was streamed */
+        } else if (FrameSize == XMODEM_1K_BLOCK_SIZE) {
+            if (FrameVerified && (ChunksWritten == XMODEM_1K_ALL_CHUNKS)) {
+                NextReceiveFrame();
+                return;
+            }
+            if (Valid && !FrameVerified) {
+                /* Nothing passed on yet, the next copies provide the data */
+                FrameVerified = true;
+                ChunksWritten = 0;
+            }
+            /* Damaged, only checked so far or chunks still missing */
+            TerminalSendByte(BYTE_NAK);
+            State = STATE_RECEIVE_WAIT;
+            return;
+        } else if (!Valid) {
+            /* Data seems to be damaged */
+            TerminalSendByte(BYTE_NAK);
+            State = STATE_RECEIVE_WAIT;
+            return;
+        } else if (CallbackFunc(TerminalBuffer, BlockAddress, XMODEM_BLOCK_SIZE)) {
+            NextReceiveFrame();
+            return;
+        }
+
+        /* Application signals to cancel the transmission */
+        TerminalSendByte(BYTE_CAN);
+        TerminalSendByte(BYTE_CAN);
+        State = STATE_OFF;
+    } else if (ReceivedFrameNumber == (uint8_t) (CurrentFrameNumber - 1)) {
+        /* This is a retransmission */
+        TerminalSendByte(BYTE_ACK);
+        State = STATE_RECEIVE_WAIT;
+    } else {
+        /* This frame is completely out of order. Just cancel */
+        TerminalSendByte(BYTE_CAN);
+        State = STATE_OFF;
+    }
+}
+
 void XModemReceive(XModemCallbackType TheCallbackFunc)
 {
     State = STATE_RECEIVE_INIT;
@@ -58,6 +199,8 @@ void XModemReceive(XModemCallbackType TheCallbackFunc)
     RetryCount = RECV_INIT_COUNT;
     RetryTimeout = RECV_INIT_TIMEOUT;
     BlockAddress = 0;
+    CrcMode = true;
+    FrameVerified = false;
 
     CallbackFunc = TheCallbackFunc;
 }
@@ -76,10 +219,13 @@ bool XModemProcessByte(uint8_t Byte)
     switch(State) {
     case STATE_RECEIVE_INIT:
     case STATE_RECEIVE_WAIT:
-        if (Byte == BYTE_SOH) {
+        if ( (Byte == BYTE_SOH) || (Byte == BYTE_STX) ) {
             /* Next frame incoming */
+            FrameSize = (Byte == BYTE_STX) ? XMODEM_1K_BLOCK_SIZE : XMODEM_BLOCK_SIZE;
             BufferIdx = 0;
             Checksum = CHECKSUM_INIT_VALUE;
+            Crc = CRC_INIT_VALUE;
+            Cancelled = false;
             State = STATE_RECEIVE_FRAMENUM1;
         } else if (Byte == BYTE_EOT) {
             /* Transmission finished */
@@ -114,9 +260,17 @@ bool XModemProcessByte(uint8_t Byte)
 
     case STATE_RECEIVE_DATA:
         /* Process byte and update checksum */
-        TerminalBuffer[BufferIdx++] = Byte;
+        TerminalBuffer[BufferIdx % XMODEM_BLOCK_SIZE] = Byte;
+        Checksum += Byte;
+        Crc = _crc_xmodem_update(Crc, Byte);
+        BufferIdx++;
+
+        if ( (FrameSize == XMODEM_1K_BLOCK_SIZE) && (BufferIdx % XMODEM_BLOCK_SIZE == 0)
+                && (ReceivedFrameNumber == CurrentFrameNumber) && !Cancelled ) {
+            ReceiveChunk(BufferIdx / XMODEM_BLOCK_SIZE - 1);
+        }
 
-        if (BufferIdx == XMODEM_BLOCK_SIZE) {
+        if (BufferIdx == FrameSize) {
             /* Block full */
             State = STATE_RECEIVE_PROCESS;
         }
@@ -124,44 +278,26 @@ bool XModemProcessByte(uint8_t Byte)
         break;
 
     case STATE_RECEIVE_PROCESS:
-        if (ReceivedFrameNumber == CurrentFrameNumber) {
-            /* This is the expected frame. Calculate and verify checksum */
-
-            if (CalcChecksum(TerminalBuffer, XMODEM_BLOCK_SIZE) == Byte) {
-                /* Checksum is valid. Pass received data to callback function */
-                if (CallbackFunc(TerminalBuffer, BlockAddress, XMODEM_BLOCK_SIZE)) {
-                    /* Proceed to next frame and send ACK */
-                    CurrentFrameNumber++;
-                    BlockAddress += XMODEM_BLOCK_SIZE;
-                    TerminalSendChar(BYTE_ACK);
-                    State = STATE_RECEIVE_WAIT;
-                } else {
-                    /* Application signals to cancel the transmission */
-                    TerminalSendByte(BYTE_CAN);
-                    TerminalSendByte(BYTE_CAN);
-                    State = STATE_OFF;
-                }
-            } else {
-                /* Data seems to be damaged */
-                TerminalSendByte(BYTE_NAK);
-                State = STATE_RECEIVE_WAIT;
-            }
-        } else if (ReceivedFrameNumber == (CurrentFrameNumber - 1)) {
-            /* This is a retransmission */
-            TerminalSendByte(BYTE_ACK);
-            State = STATE_RECEIVE_WAIT;
+        if (CrcMode) {
+            /* CRC high byte first */
+            ReceivedCrc = (uint16_t) Byte << 8;
+            State = STATE_RECEIVE_CRC_LOW;
         } else {
-            /* This frame is completely out of order. Just cancel */
-            TerminalSendByte(BYTE_CAN);
-            State = STATE_OFF;
+            ReceiveFrameDone(Checksum == Byte);
         }
 
         break;
 
+    case STATE_RECEIVE_CRC_LOW:
+        ReceiveFrameDone((ReceivedCrc | Byte) == Crc);
+        break;
+
     case STATE_SEND_INIT:
-        /* Start sending on NAK */
-        if (Byte == BYTE_NAK) {
+        /* Start sending on NAK, or on 'C' with CRC and 1K frames */
+        if ( (Byte == BYTE_NAK) || (Byte == BYTE_C) ) {
+            CrcMode = (Byte == BYTE_C);
             CurrentFrameNumber = FIRST_FRAME_NUMBER - 1;
+            FrameSize = 0;
             Byte = BYTE_ACK;
         }
 
@@ -174,27 +310,18 @@ bool XModemProcessByte(uint8_t Byte)
             State = STATE_OFF;
         } else if (Byte == BYTE_ACK) {
             /* Acknowledge. Proceed to next frame, get data and calc checksum */
+            BlockAddress += FrameSize;
             CurrentFrameNumber++;
 
-            if (CallbackFunc(TerminalBuffer, BlockAddress, XMODEM_BLOCK_SIZE)) {
-                TerminalSendByte(BYTE_SOH);
-                TerminalSendByte(CurrentFrameNumber);
-                TerminalSendByte(255 - CurrentFrameNumber);
-                TerminalSendBlock(TerminalBuffer, XMODEM_BLOCK_SIZE);
-                TerminalSendByte(CalcChecksum(TerminalBuffer, XMODEM_BLOCK_SIZE));
-
-                BlockAddress += XMODEM_BLOCK_SIZE;
+            if (SendNextFrame()) {
+                State = STATE_SEND_WAIT;
             } else {
                 TerminalSendByte(BYTE_EOT);
                 State = STATE_SEND_EOT;
             }
         } else if (Byte == BYTE_NAK){
             /* Resend frame */
-            TerminalSendByte(BYTE_SOH);
-            TerminalSendByte(CurrentFrameNumber);
-            TerminalSendByte(255 - CurrentFrameNumber);
-            TerminalSendBlock(TerminalBuffer, XMODEM_BLOCK_SIZE);
-            TerminalSendByte(CalcChecksum(TerminalBuffer, XMODEM_BLOCK_SIZE));
+            SendFrame();
         } else {
             /* Ignore other chars */
         }
@@ -214,6 +341,11 @@ bool XModemProcessByte(uint8_t Byte)
     return true;
 }
 
+bool XModemIsBusy(void)
+{
+    return (State != STATE_OFF);
+}
+
 void XModemTick(void)
 {
     /* Timeouts go here */
@@ -221,8 +353,11 @@ void XModemTick(void)
     case STATE_RECEIVE_INIT:
         if (RetryTimeout-- == 0) {
             if (RetryCount-- > 0) {
-                /* Put out communication request */
-                TerminalSendChar(BYTE_NAK);
+                /* Put out communication request, CRC mode first */
+                if (RetryCount < RECV_INIT_COUNT - RECV_CRC_COUNT) {
+                    CrcMode = false;
+                }
+                TerminalSendChar(CrcMode ? BYTE_C : BYTE_NAK);
             } else {
                 /* Just shut off after some time. */
                 State = STATE_OFF;
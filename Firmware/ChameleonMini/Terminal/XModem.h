@@ -16,6 +16,7 @@ void XModemReceive(XModemCallbackType CallbackFunc);
 void XModemSend(XModemCallbackType CallbackFunc);
 
 bool XModemProcessByte(uint8_t Byte);
+bool XModemIsBusy(void);
 void XModemTick(void);
 
 #endif /* TERMINALXMODEM_H_ */
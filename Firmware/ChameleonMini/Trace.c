@@ -0,0 +1,139 @@
+/*
+ * Trace.c
+ *
+ *  The codec pushes one record per frame into a single producer, single consumer
+ *  ring. The terminal drains it from the main loop, only as far as the USB IN
+ *  endpoint (or the terminal TX ring with SUPPORT_USB_INTERRUPT) accepts data
+ *  without waiting, so the host never holds back the RF path.
+ *  Records that do not fit into the ring are counted and reported by a drop record.
+ */
+
+#ifdef SUPPORT_LIVE_TRACE
+
+#include "Trace.h"
+#include "Terminal/Terminal.h"
+
+bool TraceEnabled = false;
+
+static uint8_t TraceBuffer[TRACE_BUFFER_SIZE];
+static volatile uint8_t TraceHead = 0; /* Only written by the producer */
+static volatile uint8_t TraceTail = 0; /* Only written by the consumer */
+static uint8_t TraceRecordLeft = 0; /* Bytes of the record being sent still to go out */
+static uint16_t TraceDropped = 0; /* Records lost since the last drop record */
+static uint32_t TraceDroppedTotal = 0;
+
+INLINE uint8_t TraceFree(void) {
+    return (uint8_t) (TraceTail - TraceHead - 1);
+}
+
+INLINE uint8_t TraceFrameLength(uint16_t BitCount) {
+    return MIN((BitCount + BITS_PER_BYTE - 1) / BITS_PER_BYTE, TRACE_FRAME_MAX_LEN);
+}
+
+static uint8_t TracePutHeader(uint8_t Head, uint8_t Type, uint32_t Timestamp, uint16_t Value) {
+    TraceBuffer[Head++] = Type;
+    TraceBuffer[Head++] = (uint8_t) Timestamp;
+    TraceBuffer[Head++] = (uint8_t) (Timestamp >> 8);
+    TraceBuffer[Head++] = (uint8_t) (Timestamp >> 16);
+    TraceBuffer[Head++] = (uint8_t) (Timestamp >> 24);
+    TraceBuffer[Head++] = (uint8_t) Value;
+    TraceBuffer[Head++] = (uint8_t) (Value >> 8);
+    return Head;
+}
+
+void TraceSetEnabled(bool Enabled) {
+    TraceEnabled = Enabled;
+    TraceDropped = 0;
+    TraceDroppedTotal = 0;
+}
+
+uint32_t TraceGetDropped(void) {
+    return TraceDroppedTotal;
+}
+
+void TraceFrameRecord(uint8_t Type, uint32_t Timestamp, const uint8_t * Data, uint16_t BitCount) {
+    uint8_t ByteCount = TraceFrameLength(BitCount);
+    uint8_t Needed = TRACE_RECORD_HEADER_LEN + ByteCount;
+    uint8_t Head = TraceHead;
+
+    if (TraceDropped > 0) {
+        Needed += TRACE_RECORD_HEADER_LEN;
+    }
+    if (Needed > TraceFree()) {
+        if (TraceDropped < UINT16_MAX) {
+            TraceDropped++;
+        }
+        TraceDroppedTotal++;
+        return;
+    }
+
+    if (TraceDropped > 0) {
+        Head = TracePutHeader(Head, TRACE_RECORD_DROPPED, Timestamp, TraceDropped);
+        TraceDropped = 0;
+    }
+    Head = TracePutHeader(Head, Type, Timestamp, BitCount);
+    while (ByteCount-- > 0) {
+        TraceBuffer[Head++] = *Data++;
+    }
+    /* Publish the whole record at once */
+    TraceHead = Head;
+}
+
+/* Length of the record starting at Tail */
+static uint8_t TraceRecordLength(uint8_t Tail) {
+    uint16_t Value = TraceBuffer[(uint8_t) (Tail + 5)] | (TraceBuffer[(uint8_t) (Tail + 6)] << 8);
+    if (TraceBuffer[Tail] == TRACE_RECORD_DROPPED) {
+        return TRACE_RECORD_HEADER_LEN;
+    }
+    return TRACE_RECORD_HEADER_LEN + TraceFrameLength(Value);
+}
+
+/* Returns true while a record has only partly been sent. Nothing else may then be
+ * written to the terminal, or the host would lose track of the records. */
+bool TraceTask(void) {
+    if ( (USB_DeviceState != DEVICE_STATE_Configured) || !(TerminalHandle.State.LineEncoding.BaudRateBPS) ) {
+        /* Nobody listening, keep the ring fresh for the next host */
+        TraceTail = TraceHead;
+        TraceRecordLeft = 0;
+        return false;
+    }
+    if ( (TraceRecordLeft == 0) && XModemIsBusy() ) {
+        /* Do not corrupt a transfer, records pile up or get dropped meanwhile */
+        return false;
+    }
+
+#ifdef SUPPORT_USB_INTERRUPT
+    while ( (TraceTail != TraceHead) && (TerminalSendFree() > 0) ) {
+        uint8_t Tail = TraceTail;
+        if (TraceRecordLeft == 0) {
+            TraceRecordLeft = TraceRecordLength(Tail);
+        }
+        TerminalSendByte(TraceBuffer[Tail]);
+        TraceTail = Tail + 1;
+        TraceRecordLeft--;
+    }
+#else
+    Endpoint_SelectEndpoint(TerminalHandle.Config.DataINEndpoint.Address);
+    while (TraceTail != TraceHead) {
+        uint8_t Tail = TraceTail;
+        if (!Endpoint_IsINReady()) {
+            /* Host did not fetch the last packet yet */
+            break;
+        }
+        if (!Endpoint_IsReadWriteAllowed()) {
+            Endpoint_ClearIN();
+            continue;
+        }
+        if (TraceRecordLeft == 0) {
+            TraceRecordLeft = TraceRecordLength(Tail);
+        }
+        Endpoint_Write_8(TraceBuffer[Tail]);
+        TraceTail = Tail + 1;
+        TraceRecordLeft--;
+    }
+#endif
+
+    return (TraceRecordLeft > 0);
+}
+
+#endif /* SUPPORT_LIVE_TRACE */
@@ -0,0 +1,44 @@
+/*
+ * Trace.h
+ *
+ *  Live trace of the reader/tag exchanges, streamed to the host over the
+ *  USB CDC terminal while emulating. Enabled with TRACE=1.
+ */
+
+#ifdef SUPPORT_LIVE_TRACE
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "Common.h"
+
+/* Ring between the codec (producer) and the terminal (consumer). With 8 bit
+ * indices and 256 bytes, index wrap around is free and atomic on the AVR. */
+#define TRACE_BUFFER_SIZE           256
+#define TRACE_FRAME_MAX_LEN         32 /* Frame bytes kept per record, larger frames are cut */
+
+/* Record: type (1 byte) | timestamp (4 bytes LE, see SystemGetTimestamp) | bit count (2 bytes LE)
+ * | frame bytes. Types have the high bit set, so the host can tell them from terminal text. */
+#define TRACE_RECORD_HEADER_LEN     7
+#define TRACE_RECORD_READER         0xE0
+#define TRACE_RECORD_TAG            0xE1
+#define TRACE_RECORD_DROPPED        0xE2 /* Header only, bit count field holds the number of records lost */
+
+extern bool TraceEnabled;
+
+void TraceSetEnabled(bool Enabled);
+uint32_t TraceGetDropped(void);
+
+void TraceFrameRecord(uint8_t Type, uint32_t Timestamp, const uint8_t * Data, uint16_t BitCount);
+bool TraceTask(void);
+
+/* Cheap enough to be called from the RF path while tracing is off */
+INLINE void TraceFrame(uint8_t Type, uint32_t Timestamp, const uint8_t * Data, uint16_t BitCount) {
+    if (TraceEnabled) {
+        TraceFrameRecord(Type, Timestamp, Data, BitCount);
+    }
+}
+
+#endif /* TRACE_H_ */
+
+#endif /* SUPPORT_LIVE_TRACE */
@@ -0,0 +1,119 @@
+#!/usr/bin/python
+
+from __future__ import print_function
+import sys
+import struct
+import binascii
+
+"""
+Host side of the binary command mode of firmware built with SUPPORT_BINARY_PROTOCOL.
+
+Usage:  binary_client.py /dev/ttyACM0 [uid]
+Prints version, configuration, setting and UID, then returns to the text mode.
+
+Requests are: opcode | sequence | length (LE) | payload | CRC-16/XModem (LE).
+Answers are:  opcode | sequence | status | length (LE) | payload | CRC-16/XModem (LE).
+Several requests may be written before reading the answers, see pipeline().
+"""
+
+MAGIC = b'\xFE\x01\xB1\x9C'
+
+OP_PING = 0x00
+OP_EXIT = 0x01
+OP_VERSION = 0x02
+OP_GET_CONFIG = 0x10
+OP_SET_CONFIG = 0x11
+OP_GET_UID = 0x12
+OP_SET_UID = 0x13
+OP_GET_SETTING = 0x14
+OP_SET_SETTING = 0x15
+OP_GET_MEMSIZE = 0x16
+OP_READ_MEM = 0x20
+OP_WRITE_MEM = 0x21
+OP_READ_WORKMEM = 0x22
+OP_WRITE_WORKMEM = 0x23
+
+STATUS_NAMES = {0: 'OK', 1: 'CRC ERROR', 2: 'UNKNOWN OPCODE', 3: 'INVALID PARAM', 4: 'FAILED'}
+
+def crc16(data):
+    crc = 0
+    for byte in bytearray(data):
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+class BinaryError(Exception):
+    pass
+
+class BinaryClient(object):
+    def __init__(self, port):
+        self.port = port
+        self.sequence = 0
+
+    def enter(self):
+        self.port.write(MAGIC)
+
+    def encode(self, opcode, payload=b''):
+        frame = struct.pack('<BBH', opcode, self.sequence, len(payload)) + payload
+        self.sequence = (self.sequence + 1) & 0xFF
+        return frame + struct.pack('<H', crc16(frame))
+
+    def read_exact(self, count):
+        data = b''
+        while len(data) < count:
+            chunk = self.port.read(count - len(data))
+            if not chunk:
+                raise BinaryError('Timeout')
+            data += chunk
+        return data
+
+    def read_answer(self):
+        header = self.read_exact(5)
+        opcode, sequence, status, length = struct.unpack('<BBBH', header)
+        payload = self.read_exact(length)
+        crc, = struct.unpack('<H', self.read_exact(2))
+        if crc != crc16(header + payload):
+            raise BinaryError('Answer CRC mismatch')
+        return opcode, sequence, status, payload
+
+    def pipeline(self, requests):
+        """Writes all (opcode, payload) requests at once, then collects the answers in order"""
+        self.port.write(b''.join(self.encode(opcode, payload) for opcode, payload in requests))
+        return [self.read_answer() for _ in requests]
+
+    def request(self, opcode, payload=b''):
+        _, _, status, answer = self.pipeline([(opcode, payload)])[0]
+        if status != 0:
+            raise BinaryError(STATUS_NAMES.get(status, 'STATUS %u' % status))
+        return answer
+
+    def read_mem(self, address, length, opcode=OP_READ_MEM):
+        return self.request(opcode, struct.pack('<IH', address, length))
+
+    def write_mem(self, address, data, opcode=OP_WRITE_MEM):
+        self.request(opcode, struct.pack('<I', address) + data)
+
+def main(argv):
+    import serial
+    if len(argv) < 2:
+        print('Usage:', argv[0], '/dev/ttyACM0 [uid]')
+        sys.exit(1)
+    port = serial.Serial(argv[1], timeout=1)
+    client = BinaryClient(port)
+    client.enter()
+    try:
+        if len(argv) > 2:
+            client.request(OP_SET_UID, binascii.unhexlify(argv[2]))
+        answers = client.pipeline([(OP_VERSION, b''), (OP_GET_CONFIG, b''), (OP_GET_SETTING, b''), (OP_GET_UID, b'')])
+        version, config, setting, uid = [payload for _, _, _, payload in answers]
+        print('Version:', version.decode('ascii', 'replace'))
+        print('Configuration id:', bytearray(config)[0], 'Setting:', bytearray(setting)[0])
+        print('UID:', binascii.hexlify(uid).decode().upper())
+    finally:
+        client.request(OP_EXIT)
+        port.close()
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,74 @@
+#!/usr/bin/python
+
+from __future__ import print_function
+import re
+import sys
+
+"""
+Checks that the command line tables in Terminal/CommandLine.c are sorted as
+their binary searches expect: CommandTable by name in strcmp order, with
+COMMAND_LIST_END last, and StatusTable by status id.
+
+Run by the firmware Makefile on the preprocessed source, so that the
+configured SETTINGS decide which entries are there:
+  avr-gcc -E <flags> Terminal/CommandLine.c | check_cmd_tables.py
+Exits with an error, failing the build, when a table is out of order.
+"""
+
+STRING_LITERALS = r'((?:"(?:[^"\\]|\\.)*"\s*)+)'
+
+def table_body(source, name):
+    match = re.search(r'\b' + name + r'\s*\[\s*\]\s*=\s*\{', source)
+    if match is None:
+        return None
+    depth = 1
+    pos = match.end()
+    while depth > 0 and pos < len(source):
+        if source[pos] == '{':
+            depth += 1
+        elif source[pos] == '}':
+            depth -= 1
+        pos += 1
+    return source[match.end():pos - 1]
+
+def join_literals(literals):
+    return ''.join(re.findall(r'"((?:[^"\\]|\\.)*)"', literals))
+
+def check_order(name, keys, errors):
+    for prev, cur in zip(keys, keys[1:]):
+        if not prev < cur:
+            errors.append('%s: %r must come after %r' % (name, prev, cur))
+
+def check(source):
+    errors = []
+    commands = table_body(source, 'CommandTable')
+    statuses = table_body(source, 'StatusTable')
+    if commands is None or statuses is None:
+        return ['CommandTable or StatusTable not found']
+
+    names = [join_literals(m) for m in re.findall(r'\.Command\s*=\s*' + STRING_LITERALS, commands)]
+    if not names or names[-1] != '':
+        errors.append('CommandTable: COMMAND_LIST_END must be the last entry')
+    else:
+        # strcmp_P() compares bytes, as Python does for ASCII
+        check_order('CommandTable', names[:-1], errors)
+
+    ids = [int(m, 0) for m in re.findall(r'\{\s*(\w+)\s*,', statuses)]
+    check_order('StatusTable', ids, errors)
+    return errors
+
+def main(argv):
+    if len(argv) > 1:
+        with open(argv[1]) as file_inp:
+            lines = file_inp.readlines()
+    else:
+        lines = sys.stdin.readlines()
+    # Drop the line markers of the preprocessor
+    source = ''.join(line for line in lines if not line.startswith('#'))
+    errors = check(source)
+    for error in errors:
+        print('check_cmd_tables:', error, file=sys.stderr)
+    sys.exit(1 if errors else 0)
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,115 @@
+#!/usr/bin/python
+
+from __future__ import print_function
+import sys
+import struct
+import binascii
+
+"""
+Decodes the binary log written by the MF_CLASSIC_LOG configuration.
+
+Fetch the whole log with WORKMEMDOWNLOAD, or the records from a sequence
+number on with LOGSYNC=<seq>, while the MF_CLASSIC_LOG slot is active, then
+run:  mfc_log_decode.py workmem.bin [output.txt]
+
+A full log starts with a 32 byte header (status canary, format, sequence
+numbers, bytes written), a LOGSYNC stream with a 16 byte header (magic,
+format, flags, first sequence number, length, next sequence number).
+Records follow, made of: timestamp (4 bytes LE, 0.25 us) | info (1 byte) |
+bit count (2 bytes LE) | frame bytes. Identical exchanges following each
+other are stored once, followed by a repeat record holding the number of
+repetitions and the time of the last one.
+"""
+
+HEADER_LEN = 32
+STATUS_CANARY = (0x70, 0x71)
+FORMAT_BINARY = 0x03
+FIRSTSEQ_OFFSET = 4
+WROTEBYTES_OFFSET = 12
+
+SYNC_HEADER = struct.Struct('<BBBxIII')
+SYNC_MAGIC = 0x4C
+SYNC_LOST = 0x01
+SYNC_RESET = 0x02
+
+RECORD_HEADER = struct.Struct('<IBH')
+TIMESTAMP_FREQ = 4000000
+DIR_TAG = 0x80
+TRUNCATED = 0x40
+STATE_MASK = 0x3F
+BUFFER_OVERFLOW = 0x0F
+REPEAT = 0x0E
+
+# Same order as enum estate in MifareClassic.c
+STATES = ['HALT', 'IDLE', 'CHINESE_IDLE', 'CHINESE_WRITE', 'READY', 'ACTIVE',
+          'AUTHING', 'AUTHED_IDLE', 'WRITE', 'INCREMENT', 'DECREMENT', 'RESTORE']
+
+def format_time(timestamp):
+    # Milliseconds with microsecond resolution
+    return '%11.3f' % (timestamp * 1000.0 / TIMESTAMP_FREQ)
+
+def decode(data, out):
+    data = bytearray(data)
+    if len(data) >= SYNC_HEADER.size and data[0] == SYNC_MAGIC:
+        magic, fmt, flags, seq, length, nextseq = SYNC_HEADER.unpack_from(data, 0)
+        if fmt != FORMAT_BINARY:
+            raise ValueError('unsupported log format')
+        if flags & SYNC_LOST:
+            print('*** requested records were overwritten, resuming at #%u ***' % seq, file=out)
+        if flags & SYNC_RESET:
+            print('*** log was restarted, resuming at #%u ***' % seq, file=out)
+        idx = SYNC_HEADER.size
+        end = min(idx + length, len(data))
+    else:
+        if len(data) < HEADER_LEN or data[0] not in STATUS_CANARY:
+            raise ValueError('no log header found')
+        if data[1] != FORMAT_BINARY:
+            raise ValueError('unsupported log format')
+        seq = struct.unpack_from('<I', data, FIRSTSEQ_OFFSET)[0]
+        wrote = struct.unpack_from('<I', data, WROTEBYTES_OFFSET)[0]
+        nextseq = None
+        idx = HEADER_LEN
+        end = min(HEADER_LEN + wrote, len(data))
+
+    while idx + RECORD_HEADER.size <= end:
+        timestamp, info, bitcount = RECORD_HEADER.unpack_from(data, idx)
+        idx += RECORD_HEADER.size
+        source = 'T' if info & DIR_TAG else 'R'
+        state = info & STATE_MASK
+        seq += 1
+        if state == BUFFER_OVERFLOW:
+            print('#%u [%s] %s:\t*** buffer overflow, frames lost ***' % (seq - 1, format_time(timestamp), source), file=out)
+            continue
+        if state == REPEAT:
+            print('#%u [%s] --:\t*** previous exchange repeated %u more time(s) ***' % (seq - 1, format_time(timestamp), bitcount), file=out)
+            continue
+        nbytes = (bitcount + 7) // 8
+        if idx + nbytes > end:
+            # Rest of the record was not committed yet
+            break
+        frame = data[idx:idx + nbytes]
+        idx += nbytes
+        name = STATES[state] if state < len(STATES) else 'STATE_%u' % state
+        bits = ' (%u bits)' % bitcount if bitcount % 8 else ''
+        if info & TRUNCATED:
+            bits += ' (truncated)'
+        print('#%u [%s] %s:\t%s\t| %s ;%s' % (seq - 1, format_time(timestamp), source, name,
+              binascii.hexlify(bytes(frame)).decode().upper(), bits), file=out)
+
+    if nextseq is not None:
+        print('*** next LOGSYNC=%u ***' % nextseq, file=out)
+
+def main(argv):
+    if len(argv) < 2:
+        print('Usage:', argv[0], 'workmem.bin [output.txt]')
+        sys.exit(1)
+    with open(argv[1], 'rb') as file_inp:
+        data = file_inp.read()
+    if len(argv) > 2:
+        with open(argv[2], 'w') as file_out:
+            decode(data, file_out)
+    else:
+        decode(data, sys.stdout)
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,85 @@
+#!/usr/bin/python
+
+from __future__ import print_function
+import sys
+import struct
+import binascii
+
+"""
+Decodes the live trace streamed by firmware built with SUPPORT_LIVE_TRACE.
+
+Enable it with TRACE=1, then run:  trace_decode.py /dev/ttyACM0
+(or a file holding a raw capture of the terminal output).
+
+Records are made of: type (1 byte) | timestamp (4 bytes LE, 0.25 us) |
+bit count (2 bytes LE) | frame bytes, at most 32 of them. Record types have
+the high bit set, anything else in the stream is terminal text.
+"""
+
+RECORD_HEADER = struct.Struct('<BIH')
+TIMESTAMP_FREQ = 4000000
+FRAME_MAX_LEN = 32
+RECORD_READER = 0xE0
+RECORD_TAG = 0xE1
+RECORD_DROPPED = 0xE2
+
+def open_input(path):
+    file_inp = open(path, 'rb', 0)
+    if file_inp.isatty():
+        import tty
+        tty.setraw(file_inp.fileno())
+    return file_inp
+
+def format_time(timestamp):
+    # Milliseconds with microsecond resolution
+    return '%11.3f' % (timestamp * 1000.0 / TIMESTAMP_FREQ)
+
+def read_exact(file_inp, count):
+    data = b''
+    while len(data) < count:
+        chunk = file_inp.read(count - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+def decode(file_inp, out):
+    while True:
+        first = file_inp.read(1)
+        if not first:
+            break
+        if bytearray(first)[0] < 0x80:
+            # Terminal answer in between records
+            out.write(first.decode('ascii', 'replace'))
+            continue
+        rest = read_exact(file_inp, RECORD_HEADER.size - 1)
+        if rest is None:
+            break
+        rtype, timestamp, value = RECORD_HEADER.unpack(first + rest)
+        if rtype == RECORD_DROPPED:
+            print('[%s] *** %u record(s) dropped ***' % (format_time(timestamp), value), file=out)
+            continue
+        nbytes = min((value + 7) // 8, FRAME_MAX_LEN)
+        frame = read_exact(file_inp, nbytes)
+        if frame is None:
+            break
+        source = {RECORD_READER: 'R', RECORD_TAG: 'T'}.get(rtype, '?')
+        bits = ' (%u bits)' % value if value % 8 else ''
+        if nbytes * 8 < value:
+            bits += ' (truncated)'
+        print('[%s] %s:\t%s ;%s' % (format_time(timestamp), source,
+              binascii.hexlify(frame).decode().upper(), bits), file=out)
+        out.flush()
+
+def main(argv):
+    if len(argv) < 2:
+        print('Usage:', argv[0], '/dev/ttyACM0|capture.bin')
+        sys.exit(1)
+    with open_input(argv[1]) as file_inp:
+        try:
+            decode(file_inp, sys.stdout)
+        except KeyboardInterrupt:
+            pass
+
+if __name__ == '__main__':
+    main(sys.argv)